@@ -0,0 +1,338 @@
+// Benchmark harness: compiles each corpus program with 'mhs_compiler --time-phases',
+// builds it with $CXX (default g++) the way the README describes, runs it and writes the front-end
+// phase times, build time, run time and peak RSS as JSON. With --baseline, results
+// are compared against an earlier run; regressions are listed and the exit status is 1.
+//
+//   bench/harness [--root DIR] [--runs N] [--out FILE] [--baseline FILE] [--threshold PCT] [name...]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// input: what the program reads on stdin. "lines" is a generated text file whose path
+// is passed on stdin; "source" means the program prints an MHS program, which is then
+// measured through the front end only; "split" builds that printed program with
+// 'mhs_compiler run', as one unit and as --split N.
+struct Benchmark { const char* name; const char* file; const char* input; };
+static const std::vector<Benchmark> suite = {
+    {"fib", "fib.mhs", ""},
+    {"sieve", "sieve.mhs", ""},
+    {"array_fill", "array_fill.mhs", ""},
+    {"string_build", "string_build.mhs", ""},
+    {"word_count", "word_count.mhs", ""},
+    {"method_calls", "method_calls.mhs", ""},
+    {"alloc", "alloc.mhs", ""},
+    {"sort", "sort.mhs", ""},
+    {"file_lines", "file_lines.mhs", "lines"},
+    {"for_loop", "for_loop.mhs", ""},
+    {"literals", "literals.mhs", ""},
+    {"large_arguments", "large_arguments.mhs", ""},
+    {"parallel_for", "parallel_for.mhs", ""},
+    {"large_source", "gen_large_source.mhs", "source"},
+    {"large_source_build", "gen_large_source.mhs", "split"},
+};
+
+struct Process { int status = -1; double ms = 0; long peakRssKb = 0; };
+
+// Runs args in dir with stdin/stdout/stderr redirected to files ("" keeps /dev/null).
+static Process spawn(const std::vector<std::string>& args, const fs::path& dir, const std::string& in, const std::string& out, const std::string& err) {
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (chdir(dir.c_str()) != 0) _exit(127);
+        auto redirect = [](const std::string& path, int fd, int flags) {
+            int f = open(path.empty() ? "/dev/null" : path.c_str(), flags, 0644);
+            if (f >= 0) { dup2(f, fd); close(f); }
+        };
+        redirect(in, 0, O_RDONLY);
+        redirect(out, 1, O_WRONLY | O_CREAT | O_TRUNC);
+        redirect(err, 2, O_WRONLY | O_CREAT | O_TRUNC);
+        std::vector<char*> argv;
+        for (auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+        argv.push_back(nullptr);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    Process p;
+    struct rusage ru;
+    int st = 0;
+    if (pid > 0 && wait4(pid, &st, 0, &ru) == pid) {
+        p.status = WIFEXITED(st) ? WEXITSTATUS(st) : -1;
+        p.peakRssKb = ru.ru_maxrss;
+    }
+    p.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return p;
+}
+
+static std::string readFile(const fs::path& path) {
+    std::ifstream f(path, std::ios::binary);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    return ss.str();
+}
+
+// FNV-1a of the program's stdout, so a change in behaviour shows up next to the timings.
+static std::string digest(const std::string& s) {
+    unsigned long long h = 1469598103934665603ULL;
+    for (unsigned char c : s) { h ^= c; h *= 1099511628211ULL; }
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", h);
+    return buf;
+}
+
+// One benchmark's measurements, in the order they are written.
+struct Result {
+    std::string name, output;
+    std::vector<std::pair<std::string, double>> metrics;
+    void set(const std::string& key, double v) {
+        for (auto& m : metrics) if (m.first == key) { m.second = v; return; }
+        metrics.push_back({key, v});
+    }
+};
+
+class Harness {
+    fs::path root, work;
+    int runs;
+    [[noreturn]] static void fail(const std::string& msg) {
+        std::cerr << "[BENCH ERROR] " << msg << std::endl;
+        exit(2);
+    }
+    // Front end: --time-phases prints "phase: N ms" lines; the fastest of the runs is kept.
+    void frontEnd(const fs::path& source, Result& r) {
+        std::map<std::string, double> best;
+        for (int i = 0; i < runs; i++) {
+            Process p = spawn({(root / "mhs_compiler").string(), "--time-phases", source.string()}, work, "", (work / "compile.out").string(), (work / "phases.txt").string());
+            if (p.status != 0) fail("mhs_compiler failed on " + source.string() + ":\n" + readFile(work / "compile.out"));
+            std::istringstream phases(readFile(work / "phases.txt"));
+            std::map<std::string, double> run;
+            for (std::string line; std::getline(phases, line);) {
+                size_t colon = line.find(": ");
+                if (colon == std::string::npos || line.size() < 3 || line.compare(line.size() - 3, 3, " ms") != 0) continue;
+                std::string phase = line.substr(0, colon);
+                if (phase == "read") continue;
+                run[phase] = std::atof(line.c_str() + colon + 2);
+                run["frontend"] += run[phase];
+            }
+            for (auto& [k, v] : run) if (!best.count(k) || v < best[k]) best[k] = v;
+        }
+        for (const char* phase : {"lex", "parse", "optimize", "infer", "generate", "frontend"}) r.set(std::string(phase) + "_ms", best[phase]);
+    }
+    // Builds output.cpp in the work directory against the runtime it asks for.
+    void build(const std::string& name, Result* r) {
+        bool mt = readFile(work / "output.cpp").find("mhs_runtime_mt.h") != std::string::npos;
+        fs::path rt = root / "runtime";
+        // $CXX split into words, else g++, as the compiler's own 'run' does.
+        std::vector<std::string> args;
+        std::istringstream words(getenv("CXX") ? getenv("CXX") : "g++");
+        for (std::string w; words >> w;) args.push_back(w);
+        args.insert(args.end(), {"-std=c++17", "-O2", "-I" + rt.string(), "output.cpp", "-L" + rt.string(), mt ? "-lmhs_runtime_mt" : "-lmhs_runtime"});
+        if (mt) args.push_back("-pthread");
+        args.insert(args.end(), {"-o", "app"});
+        Process p = spawn(args, work, "", "", (work / "build.txt").string());
+        if (p.status != 0) fail(args[0] + " failed on " + name + ":\n" + readFile(work / "build.txt"));
+        if (r) r->set("build_ms", p.ms);
+    }
+    // 'run' with an empty cache times code generation plus the C++ build: once as one
+    // unit (build_ms) and once split into one unit per hardware thread, at least two
+    // (split_build_ms), so what --split gains on this machine's cores is visible.
+    void splitBuild(const fs::path& program, Result& r) {
+        int n = (int)std::max(2u, std::thread::hardware_concurrency());
+        for (int units : {1, n}) {
+            fs::path cache = work / ("cache-" + std::to_string(units));
+            setenv("MHS_CACHE_DIR", cache.c_str(), 1);
+            Process p = spawn({(root / "mhs_compiler").string(), "run", "--split", std::to_string(units), program.string()}, work, "", (work / "run.out").string(), (work / "run.err").string());
+            unsetenv("MHS_CACHE_DIR");
+            std::error_code ec;
+            fs::remove_all(cache, ec);
+            if (p.status != 0) fail(r.name + ": 'run --split " + std::to_string(units) + "' failed:\n" + readFile(work / "run.err"));
+            r.set(units == 1 ? "build_ms" : "split_build_ms", p.ms);
+            if (units == 1) r.output = digest(readFile(work / "run.out"));
+        }
+        r.set("split_units", n);
+    }
+    std::string stdinFor(const Benchmark& b) {
+        if (std::string(b.input) != "lines") return "";
+        fs::path data = work / "lines.txt", in = work / "lines.in";
+        if (!fs::exists(data)) {
+            std::ofstream f(data);
+            for (int i = 0; i < 1000000; i++) f << "line " << i << " of the generated input for file_lines\n";
+            std::ofstream(in) << data.string() << "\n";
+        }
+        return in.string();
+    }
+public:
+    Harness(const fs::path& root, int runs) : root(fs::absolute(root)), runs(runs) {
+        char tmpl[] = "/tmp/mhs_bench_XXXXXX";
+        if (!mkdtemp(tmpl)) fail("cannot create a work directory");
+        work = tmpl;
+    }
+    ~Harness() { std::error_code ec; fs::remove_all(work, ec); }
+    Result measure(const Benchmark& b) {
+        Result r;
+        r.name = b.name;
+        fs::path source = fs::absolute(root / "bench" / b.file);
+        if (std::string(b.input) == "source" || std::string(b.input) == "split") {
+            // Generate the program once, then time only the compiler on it.
+            frontEnd(source, r);
+            build(b.name, nullptr);
+            fs::path generated = work / (r.name + ".mhs");
+            if (spawn({"./app"}, work, "", generated.string(), "").status != 0) fail(r.name + ": generator failed");
+            r.metrics.clear();
+            if (std::string(b.input) == "split") {
+                splitBuild(generated, r);
+                return r;
+            }
+            frontEnd(generated, r);
+            r.set("source_bytes", (double)fs::file_size(generated));
+            return r;
+        }
+        frontEnd(source, r);
+        build(b.name, &r);
+        std::string in = stdinFor(b);
+        fs::path out = work / "run.out";
+        double best = 0;
+        long rss = 0;
+        for (int i = 0; i < runs; i++) {
+            Process p = spawn({"./app"}, work, in, out.string(), (work / "run.err").string());
+            if (p.status != 0) fail(r.name + " exited with status " + std::to_string(p.status) + ":\n" + readFile(work / "run.err"));
+            if (i == 0 || p.ms < best) best = p.ms;
+            rss = std::max(rss, p.peakRssKb);
+            if (i == 0) r.output = digest(readFile(out));
+        }
+        r.set("run_ms", best);
+        r.set("peak_rss_kb", (double)rss);
+        return r;
+    }
+};
+
+static std::string toJson(const std::vector<Result>& results, int runs) {
+    std::ostringstream os;
+    os << "{\n  \"runs\": " << runs << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        os << "    {\"name\": \"" << r.name << "\"";
+        for (auto& [k, v] : r.metrics) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.3f", v);
+            os << ", \"" << k << "\": " << buf;
+        }
+        if (!r.output.empty()) os << ", \"output\": \"" << r.output << "\"";
+        os << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+    return os.str();
+}
+
+// Reads back what toJson writes: each "name" starts a record, other keys fill it.
+static std::map<std::string, Result> fromJson(const std::string& text) {
+    std::map<std::string, Result> records;
+    Result* cur = nullptr;
+    size_t i = 0;
+    auto str = [&](size_t& at) {
+        std::string s;
+        for (at++; at < text.size() && text[at] != '"'; at++) s += text[at];
+        at++;
+        return s;
+    };
+    while ((i = text.find('"', i)) != std::string::npos) {
+        std::string key = str(i);
+        while (i < text.size() && (text[i] == ' ' || text[i] == ':')) i++;
+        if (i >= text.size()) break;
+        if (text[i] == '"') {
+            std::string value = str(i);
+            if (key == "name") { cur = &records[value]; cur->name = value; }
+            else if (key == "output" && cur) cur->output = value;
+        } else if (cur) cur->set(key, std::atof(text.c_str() + i));
+    }
+    return records;
+}
+
+// A metric regresses when it grows by more than threshold percent and by more than
+// a floor that keeps timer noise on tiny values out of the report.
+static int compare(const std::vector<Result>& results, const std::map<std::string, Result>& baseline, double threshold) {
+    int regressions = 0;
+    for (const Result& r : results) {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end()) continue;
+        const Result& b = it->second;
+        if (!r.output.empty() && !b.output.empty() && r.output != b.output) {
+            std::cout << "REGRESSION " << r.name << ": output changed\n";
+            regressions++;
+        }
+        for (auto& [key, now] : r.metrics) {
+            if (key != "run_ms" && key != "build_ms" && key != "split_build_ms" && key != "frontend_ms" && key != "peak_rss_kb") continue;
+            double before = -1;
+            for (auto& [k, v] : b.metrics) if (k == key) before = v;
+            double floor = key == "peak_rss_kb" ? 1024 : 5;
+            if (before < 0 || now <= before * (1 + threshold / 100) || now - before <= floor) continue;
+            printf("REGRESSION %s: %s %.1f -> %.1f (+%.0f%%)\n", r.name.c_str(), key.c_str(), before, now, before > 0 ? 100 * (now - before) / before : 100.0);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    fs::path root = ".";
+    int runs = 3;
+    double threshold = 10;
+    std::string out, baselinePath;
+    std::vector<std::string> only;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--root" && hasValue) root = argv[++i];
+        else if (arg == "--runs" && hasValue) runs = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--out" && hasValue) out = argv[++i];
+        else if (arg == "--baseline" && hasValue) baselinePath = argv[++i];
+        else if (arg == "--threshold" && hasValue) threshold = std::atof(argv[++i]);
+        else if (arg.rfind("--", 0) == 0) {
+            std::cout << "Usage: harness [--root DIR] [--runs N] [--out FILE] [--baseline FILE] [--threshold PCT] [name...]\n";
+            return 2;
+        }
+        else only.push_back(arg);
+    }
+    Harness harness(root, runs);
+    std::vector<Result> results;
+    printf("%-18s %10s %10s %10s %10s\n", "benchmark", "front ms", "build ms", "run ms", "RSS MB");
+    for (const Benchmark& b : suite) {
+        if (!only.empty() && std::find(only.begin(), only.end(), b.name) == only.end()) continue;
+        Result r = harness.measure(b);
+        std::map<std::string, double> m(r.metrics.begin(), r.metrics.end());
+        auto column = [&](const char* key, double scale, int decimals) {
+            if (!m.count(key)) return std::string("-");
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.*f", decimals, m[key] / scale);
+            return std::string(buf);
+        };
+        printf("%-18s %10s %10s %10s %10s\n", r.name.c_str(), column("frontend_ms", 1, 2).c_str(), column("build_ms", 1, 0).c_str(),
+               column("run_ms", 1, 1).c_str(), column("peak_rss_kb", 1024, 1).c_str());
+        fflush(stdout);
+        results.push_back(std::move(r));
+    }
+    std::string json = toJson(results, runs);
+    if (out.empty()) std::cout << json;
+    else std::ofstream(out) << json;
+    if (baselinePath.empty()) return 0;
+    if (!fs::exists(baselinePath)) {
+        std::cout << "No baseline at " << baselinePath << "; store one with 'make bench-baseline'.\n";
+        return 0;
+    }
+    int regressions = compare(results, fromJson(readFile(baselinePath)), threshold);
+    std::cout << (regressions ? std::to_string(regressions) + " regression(s)" : "No regressions") << " against " << baselinePath << "\n";
+    return regressions ? 1 : 0;
+}
@@ -1,3 +1,4 @@
+#include "mhs_runtime.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -5,19 +6,49 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <deque>
+#include <string_view>
+#include <thread>
 #include <limits>
 #include <memory>
+#include <new>
+#include <type_traits>
 #include <ctime>
 #include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-struct VarInfo { bool isMutable; };
+struct ASTNode;
+struct VarInfo {
+    bool isMutable;
+    ASTNode* value = nullptr;    // Optimizer: literal or stable variable this 'val' can be replaced with
+    int reg = -1;                // BytecodeGen: register holding the variable
+    bool stream = false;         // ParallelChecker: declared from lines(...), so never safe to share
+};
+
+// Static types found by TypeInference. T_UNKNOWN is the optimistic bottom of
+// the lattice; anything that cannot be proven monomorphic ends up T_DYN (a boxed Value).
+// T_STRUCT + id is an instance of the id-th struct: still a Value, but with a known layout.
+enum MhsType : int { T_UNKNOWN, T_INT, T_STR, T_INTARR, T_DYN, T_STRUCT };
+inline bool isStruct(MhsType t) { return t >= T_STRUCT; }
+inline MhsType structType(int id) { return MhsType(T_STRUCT + id); }
 
 enum TokenType {
     TOKEN_ID, TOKEN_NUMBER, TOKEN_STRING, TOKEN_ASSIGN,
     TOKEN_PLUS, TOKEN_MINUS, TOKEN_MUL, TOKEN_DIV,
     TOKEN_EQ, TOKEN_NEQ, TOKEN_GT, TOKEN_LT, TOKEN_AND, TOKEN_OR,
-    TOKEN_IF, TOKEN_ELSE, TOKEN_WHILE, TOKEN_FOR, TOKEN_TO,
+    TOKEN_IF, TOKEN_ELSE, TOKEN_WHILE, TOKEN_FOR, TOKEN_TO, TOKEN_IN, TOKEN_PARALLEL,
     TOKEN_SWITCH, TOKEN_CASE, TOKEN_COLON,
     TOKEN_LBRACE, TOKEN_RBRACE, TOKEN_LPAREN, TOKEN_RPAREN,
     TOKEN_LBRACKET, TOKEN_RBRACKET, TOKEN_COMMA, TOKEN_DOT,
@@ -25,293 +56,398 @@ enum TokenType {
     TOKEN_RETURN, TOKEN_BREAK, TOKEN_CONTINUE, TOKEN_THIS, TOKEN_EOF
 };
 
-struct Token { TokenType type; std::string value; };
+struct Token { TokenType type; std::string_view value; int line = 0, col = 0; };
+
+// Identifiers, operators and string literals in the AST view the source text,
+// which outlives the tree. '+' builds generated code straight from them.
+struct Name : std::string_view {
+    Name() = default;
+    constexpr Name(std::string_view s) : std::string_view(s) {}
+    operator std::string() const { return std::string(data(), size()); }
+};
+inline std::string operator+(std::string a, Name b) { return a.append(b.data(), b.size()); }
+inline std::string operator+(Name a, const std::string& b) { return std::string(a) + b; }
+inline std::string operator+(const char* a, Name b) { return std::string(a) + b; }
+inline std::string operator+(Name a, const char* b) { return std::string(a) + b; }
+
+// Fixed-size list carved out of the AST arena.
+template <typename T> struct Span {
+    T* items = nullptr;
+    unsigned count = 0;
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t i) const { return items[i]; }
+    T& back() const { return items[count - 1]; }
+};
+
+enum class NodeKind : unsigned char {
+    Program, Struct, Function, Method, Block,
+    Null, Number, String, Variable, Array, Map,
+    IndexAccess, MemberAccess, MethodCall, Call, BinaryOp,
+    If, While, For, ParallelFor, ForEach, Switch,
+    Return, Break, Continue, Declaration, Assignment, IndexAssignment
+};
 
+// One node layout for every kind: left/right/elseBranch plus a payload that
+// depends on the kind. Nodes and their lists live in an AstArena.
 struct ASTNode {
-    std::string type; std::string name; std::string stringValue; int numberValue = 0;
-    bool isMutable = false;
-    ASTNode *left = nullptr; ASTNode *right = nullptr; ASTNode *elseBranch = nullptr;
-    std::vector<ASTNode*> statements;
-    std::vector<ASTNode*> functions;
-    std::vector<ASTNode*> args;
-    std::vector<ASTNode*> arrayElements;
-    std::vector<std::string> params;
-    std::vector<std::pair<std::string, ASTNode*>> mapEntries;
-    std::vector<std::string> structFields;
-    std::vector<ASTNode*> cases;
-    std::vector<ASTNode*> caseBlocks;
-    std::string structName;
+    NodeKind kind;
+    bool isMutable = false;             // Declaration
+    bool moveOut = false;               // Variable: last use of a local, emitted as std::move
+    MhsType vtype = T_DYN;              // expression type, variable type or function return type
+    Name name;                          // identifier, operator or string literal text
+    ASTNode* left = nullptr; ASTNode* right = nullptr; ASTNode* elseBranch = nullptr;
+    struct SwitchCases { Span<ASTNode*> cases, blocks; };
+    struct MapEntries { Span<Name> keys; Span<ASTNode*> values; };
+    struct Signature { Span<Name> params; Span<MhsType> paramTypes; Name structName; };
+    union {
+        long long numberValue = 0;      // Number
+        long long literal;              // String: slot in the literal pool, -1 if not pooled
+        Span<ASTNode*> items;           // Program, Block, Array, Call and MethodCall arguments
+        SwitchCases sw;                 // Switch
+        MapEntries map;                 // Map
+        Signature fn;                   // Function, Method
+        Span<Name> fields;              // Struct
+    };
+    explicit ASTNode(NodeKind k) : kind(k) {}
 };
+static_assert(std::is_trivially_destructible_v<ASTNode>, "AstArena never runs destructors");
 
+// Bump allocator that owns a whole tree; everything is released at once when it goes away.
+class AstArena {
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* cur = nullptr;
+    size_t left = 0;
+    void* allocate(size_t size, size_t align) {
+        size_t pad = (align - (uintptr_t)cur % align) % align;
+        if (pad + size > left) {
+            size_t blockSize = std::max<size_t>(size + align, 1 << 16);
+            blocks.push_back(std::make_unique<char[]>(blockSize));
+            cur = blocks.back().get();
+            left = blockSize;
+            pad = (align - (uintptr_t)cur % align) % align;
+        }
+        void* p = cur + pad;
+        cur += pad + size;
+        left -= pad + size;
+        return p;
+    }
+public:
+    AstArena() = default;
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+    ASTNode* node(NodeKind k) { return new (allocate(sizeof(ASTNode), alignof(ASTNode))) ASTNode(k); }
+    Name text(std::string_view s) {
+        char* p = static_cast<char*>(allocate(s.size(), 1));
+        std::copy(s.begin(), s.end(), p);
+        return std::string_view(p, s.size());
+    }
+    template <typename T> Span<T> copy(const std::vector<T>& v) {
+        Span<T> s;
+        if (v.empty()) return s;
+        s.items = static_cast<T*>(allocate(sizeof(T) * v.size(), alignof(T)));
+        std::uninitialized_copy(v.begin(), v.end(), s.items);
+        s.count = (unsigned)v.size();
+        return s;
+    }
+};
+
+template <typename F> void forEachChild(ASTNode* n, F f) {
+    for (ASTNode* c : {n->left, n->right, n->elseBranch}) if (c) f(c);
+    switch (n->kind) {
+        case NodeKind::Program: case NodeKind::Block: case NodeKind::Array: case NodeKind::Call: case NodeKind::MethodCall:
+            for (auto c : n->items) f(c);
+            break;
+        case NodeKind::Map: for (auto c : n->map.values) f(c); break;
+        case NodeKind::Switch:
+            for (auto c : n->sw.cases) f(c);
+            for (auto c : n->sw.blocks) f(c);
+            break;
+        default: break;
+    }
+}
+
+// Keywords are found through a perfect hash fixed at compile time: one table probe
+// and one compare per identifier. Adding a keyword that collides fails the static_assert.
+struct Keyword { std::string_view text; TokenType type; };
+constexpr Keyword keywordList[] = {
+    {"fn", TOKEN_FN}, {"val", TOKEN_VAL}, {"var", TOKEN_VAR}, {"return", TOKEN_RETURN},
+    {"break", TOKEN_BREAK}, {"continue", TOKEN_CONTINUE}, {"if", TOKEN_IF}, {"else", TOKEN_ELSE},
+    {"struct", TOKEN_STRUCT}, {"while", TOKEN_WHILE}, {"for", TOKEN_FOR}, {"to", TOKEN_TO},
+    {"in", TOKEN_IN}, {"parallel", TOKEN_PARALLEL}, {"switch", TOKEN_SWITCH}, {"case", TOKEN_CASE},
+    {"null", TOKEN_NULL}, {"this", TOKEN_THIS},
+};
+constexpr size_t keywordSlot(std::string_view s) {
+    return (s.size() + 9 * ((unsigned char)s.front() + (unsigned char)s.back())) & 31;
+}
+struct KeywordTable {
+    Keyword slots[32] = {};
+    bool perfect = true;
+    constexpr KeywordTable() {
+        for (const Keyword& k : keywordList) {
+            Keyword& slot = slots[keywordSlot(k.text)];
+            if (!slot.text.empty()) perfect = false;
+            slot = k;
+        }
+    }
+    constexpr TokenType lookup(std::string_view s) const {
+        const Keyword& k = slots[keywordSlot(s)];
+        return k.text == s ? k.type : TOKEN_ID;
+    }
+};
+constexpr KeywordTable keywords;
+static_assert(keywords.perfect, "keyword hash has a collision; pick new keywordSlot constants");
+
+// Tokens view the source buffer, which must outlive them.
 class Lexer {
-    std::string source;
-    int pos = 0;
+    std::string_view source;
+    size_t pos = 0;
+    int line = 1;
+    size_t lineStart = 0;
+    std::vector<Token> tokens;
+    void add(TokenType t, size_t start, size_t len) {
+        tokens.push_back({t, source.substr(start, len), line, (int)(start - lineStart) + 1});
+    }
+    bool next(char c) const { return pos + 1 < source.size() && source[pos + 1] == c; }
 public:
-    Lexer(std::string src) : source(src) {}
+    Lexer(std::string_view src) : source(src) {}
     std::vector<Token> tokenize() {
-        std::vector<Token> tokens;
-        while (pos < source.length()) {
+        tokens.reserve(source.size() / 4 + 1);
+        while (pos < source.size()) {
             char c = source[pos];
-            if (c == '/' && pos+1 < source.length() && source[pos+1] == '/') {
-                while (pos < source.length() && source[pos] != '\n') pos++;
+            if (c == '/' && next('/')) {
+                while (pos < source.size() && source[pos] != '\n') pos++;
                 continue;
             }
-            if (isspace(c)) { pos++; continue; }
+            if (c == '\n') { pos++; line++; lineStart = pos; continue; }
+            if (isspace((unsigned char)c)) { pos++; continue; }
             if (c == '"') {
-                pos++;
-                std::string s;
-                while (pos < source.length()) {
-                    if (source[pos] == '"') break;
-                    if (source[pos] == '\\' && pos+1 < source.length()) { s += source[pos++]; s += source[pos++]; continue; }
-                    s += source[pos++];
+                size_t start = ++pos;
+                int startLine = line;
+                size_t startCol = start - lineStart;
+                while (pos < source.size() && source[pos] != '"') {
+                    if (source[pos] == '\\' && pos + 1 < source.size()) pos++;
+                    if (source[pos] == '\n') { line++; lineStart = pos + 1; }
+                    pos++;
                 }
+                tokens.push_back({TOKEN_STRING, source.substr(start, pos - start), startLine, (int)startCol});
                 pos++;
-                tokens.push_back({TOKEN_STRING, s});
                 continue;
             }
-            if (isdigit(c)) {
-                std::string n;
-                while (pos < source.length() && isdigit(source[pos])) n += source[pos++];
-                tokens.push_back({TOKEN_NUMBER, n});
+            if (isdigit((unsigned char)c)) {
+                size_t start = pos;
+                while (pos < source.size() && isdigit((unsigned char)source[pos])) pos++;
+                add(TOKEN_NUMBER, start, pos - start);
                 continue;
             }
-            if (isalpha(c) || c == '_') {
-                std::string s;
-                while (pos < source.length() && (isalnum(source[pos]) || source[pos] == '_')) s += source[pos++];
-                if (s == "fn") tokens.push_back({TOKEN_FN, "fn"});
-                else if (s == "val") tokens.push_back({TOKEN_VAL, "val"});
-                else if (s == "var") tokens.push_back({TOKEN_VAR, "var"});
-                else if (s == "return") tokens.push_back({TOKEN_RETURN, "return"});
-                else if (s == "break") tokens.push_back({TOKEN_BREAK, "break"});
-                else if (s == "continue") tokens.push_back({TOKEN_CONTINUE, "continue"});
-                else if (s == "if") tokens.push_back({TOKEN_IF, "if"});
-                else if (s == "else") tokens.push_back({TOKEN_ELSE, "else"});
-                else if (s == "struct") tokens.push_back({TOKEN_STRUCT, "struct"});
-                else if (s == "while") tokens.push_back({TOKEN_WHILE, "while"});
-                else if (s == "for") tokens.push_back({TOKEN_FOR, "for"});
-                else if (s == "to") tokens.push_back({TOKEN_TO, "to"});
-                else if (s == "switch") tokens.push_back({TOKEN_SWITCH, "switch"});
-                else if (s == "case") tokens.push_back({TOKEN_CASE, "case"});
-                else if (s == "null") tokens.push_back({TOKEN_NULL, "null"});
-                else if (s == "this") tokens.push_back({TOKEN_THIS, "this"});
-                else tokens.push_back({TOKEN_ID, s});
+            if (isalpha((unsigned char)c) || c == '_') {
+                size_t start = pos;
+                while (pos < source.size() && (isalnum((unsigned char)source[pos]) || source[pos] == '_')) pos++;
+                add(keywords.lookup(source.substr(start, pos - start)), start, pos - start);
                 continue;
             }
-            if (c == ':' && pos+1 < source.length() && source[pos+1] == '=') { tokens.push_back({TOKEN_ASSIGN, ":="}); pos += 2; continue; }
-            if (c == ':') { tokens.push_back({TOKEN_COLON, ":"}); pos++; continue; }
-            if (c == '=' && pos+1 < source.length() && source[pos+1] == '=') { tokens.push_back({TOKEN_EQ, "=="}); pos += 2; continue; }
-            if (c == '!' && pos+1 < source.length() && source[pos+1] == '=') { tokens.push_back({TOKEN_NEQ, "!="}); pos += 2; continue; }
-            if (c == '&' && pos+1 < source.length() && source[pos+1] == '&') { tokens.push_back({TOKEN_AND, "&&"}); pos += 2; continue; }
-            if (c == '|' && pos+1 < source.length() && source[pos+1] == '|') { tokens.push_back({TOKEN_OR, "||"}); pos += 2; continue; }
-            if (c == '<') { tokens.push_back({TOKEN_LT, "<"}); pos++; continue; }
-            if (c == '>') { tokens.push_back({TOKEN_GT, ">"}); pos++; continue; }
-            if (c == '(') { tokens.push_back({TOKEN_LPAREN, "("}); pos++; continue; }
-            if (c == ')') { tokens.push_back({TOKEN_RPAREN, ")"}); pos++; continue; }
-            if (c == '[') tokens.push_back({TOKEN_LBRACKET, "["});
-            else if (c == ']') tokens.push_back({TOKEN_RBRACKET, "]"});
-            else if (c == '{') tokens.push_back({TOKEN_LBRACE, "{"});
-            else if (c == '}') tokens.push_back({TOKEN_RBRACE, "}"});
-            else if (c == '+') tokens.push_back({TOKEN_PLUS, "+"});
-            else if (c == ',') tokens.push_back({TOKEN_COMMA, ","});
-            else if (c == '-') tokens.push_back({TOKEN_MINUS, "-"});
-            else if (c == '*') tokens.push_back({TOKEN_MUL, "*"});
-            else if (c == '/') tokens.push_back({TOKEN_DIV, "/"});
-            else if (c == '.') tokens.push_back({TOKEN_DOT, "."});
+            TokenType two = c == ':' && next('=') ? TOKEN_ASSIGN : c == '=' && next('=') ? TOKEN_EQ : c == '!' && next('=') ? TOKEN_NEQ
+                          : c == '&' && next('&') ? TOKEN_AND : c == '|' && next('|') ? TOKEN_OR : TOKEN_EOF;
+            if (two != TOKEN_EOF) { add(two, pos, 2); pos += 2; continue; }
+            switch (c) {
+                case ':': add(TOKEN_COLON, pos, 1); break;
+                case '<': add(TOKEN_LT, pos, 1); break;
+                case '>': add(TOKEN_GT, pos, 1); break;
+                case '(': add(TOKEN_LPAREN, pos, 1); break;
+                case ')': add(TOKEN_RPAREN, pos, 1); break;
+                case '[': add(TOKEN_LBRACKET, pos, 1); break;
+                case ']': add(TOKEN_RBRACKET, pos, 1); break;
+                case '{': add(TOKEN_LBRACE, pos, 1); break;
+                case '}': add(TOKEN_RBRACE, pos, 1); break;
+                case '+': add(TOKEN_PLUS, pos, 1); break;
+                case ',': add(TOKEN_COMMA, pos, 1); break;
+                case '-': add(TOKEN_MINUS, pos, 1); break;
+                case '*': add(TOKEN_MUL, pos, 1); break;
+                case '/': add(TOKEN_DIV, pos, 1); break;
+                case '.': add(TOKEN_DOT, pos, 1); break;
+            }
             pos++;
         }
-        tokens.push_back({TOKEN_EOF, ""});
-        return tokens;
+        tokens.push_back({TOKEN_EOF, std::string_view(), line, (int)(pos - lineStart) + 1});
+        return std::move(tokens);
     }
 };
 
 class Parser {
     std::vector<Token> tokens;
-    int pos = 0;
+    size_t pos = 0;
+    AstArena& arena;
+    ASTNode* make(NodeKind k, Name name = Name(), ASTNode* left = nullptr, ASTNode* right = nullptr) {
+        ASTNode* n = arena.node(k);
+        n->name = name;
+        n->left = left;
+        n->right = right;
+        return n;
+    }
+    // Comma-separated expressions up to the closing token, which is consumed.
+    Span<ASTNode*> parseList(TokenType close) {
+        std::vector<ASTNode*> items;
+        if (peek().type != close) {
+            items.push_back(parseExpression());
+            while (peek().type == TOKEN_COMMA) { consume(); items.push_back(parseExpression()); }
+        }
+        consume();
+        return arena.copy(items);
+    }
 public:
-    Parser(std::vector<Token> t) : tokens(t) {}
-    Token peek() { if (pos >= tokens.size()) return {TOKEN_EOF, ""}; return tokens[pos]; }
-    Token consume() { if (pos >= tokens.size()) return {TOKEN_EOF, ""}; return tokens[pos++]; }
+    Parser(std::vector<Token> t, AstArena& arena) : tokens(std::move(t)), arena(arena) {}
+    // The token vector always ends in TOKEN_EOF, which also stands in for anything past the end.
+    const Token& peek(size_t ahead = 0) const { return pos + ahead < tokens.size() ? tokens[pos + ahead] : tokens.back(); }
+    const Token& consume() { const Token& t = peek(); if (pos < tokens.size()) pos++; return t; }
     ASTNode* parseExpression();
     ASTNode* parseStatement();
     ASTNode* parseBlock();
     ASTNode* parsePrimary() {
-        Token t = consume();
-        ASTNode* n = new ASTNode();
-        if (t.type == TOKEN_NULL) { n->type = "Null"; return n; }
-        if (t.type == TOKEN_NUMBER) { n->type = "Number"; n->numberValue = std::stoi(t.value); return n; }
-        if (t.type == TOKEN_STRING) { n->type = "String"; n->stringValue = t.value; return n; }
-        if (t.type == TOKEN_LBRACKET) {
-            n->type = "Array";
-            if (peek().type != TOKEN_RBRACKET) {
-                n->arrayElements.push_back(parseExpression());
-                while (peek().type == TOKEN_COMMA) { consume(); n->arrayElements.push_back(parseExpression()); }
+        const Token& t = consume();
+        if (t.type == TOKEN_NULL) return make(NodeKind::Null);
+        if (t.type == TOKEN_NUMBER) {
+            ASTNode* n = make(NodeKind::Number);
+            if (std::from_chars(t.value.data(), t.value.data() + t.value.size(), n->numberValue).ec != std::errc()) {
+                std::cout << "[MHS ERROR] Number " << t.value << " is too large at line " << t.line << std::endl;
+                exit(1);
             }
-            consume();
+            return n;
+        }
+        if (t.type == TOKEN_STRING) {
+            ASTNode* n = make(NodeKind::String, t.value);
+            n->literal = -1;
+            return n;
+        }
+        if (t.type == TOKEN_LBRACKET) {
+            ASTNode* n = make(NodeKind::Array);
+            n->items = parseList(TOKEN_RBRACKET);
             return n;
         }
         if (t.type == TOKEN_LBRACE) {
-            n->type = "Map";
+            std::vector<Name> keys;
+            std::vector<ASTNode*> values;
             if (peek().type != TOKEN_RBRACE) {
                 while (true) {
-                    std::string key = consume().value;
+                    keys.push_back(consume().value);
                     consume(); // :
-                    ASTNode* val = parseExpression();
-                    n->mapEntries.push_back({key, val});
+                    values.push_back(parseExpression());
                     if (peek().type == TOKEN_COMMA) consume();
                     else break;
                 }
             }
             consume();
+            ASTNode* n = make(NodeKind::Map);
+            n->map.keys = arena.copy(keys);
+            n->map.values = arena.copy(values);
             return n;
         }
-        if (t.type == TOKEN_LPAREN) { delete n; n = parseExpression(); consume(); return n; }
+        if (t.type == TOKEN_LPAREN) { ASTNode* n = parseExpression(); consume(); return n; }
         if (t.type == TOKEN_ID || t.type == TOKEN_THIS) {
-            n->type = "Variable";
-            n->name = (t.type == TOKEN_THIS) ? "this" : t.value;
+            ASTNode* n = make(NodeKind::Variable, t.type == TOKEN_THIS ? Name("this") : Name(t.value));
             while (peek().type == TOKEN_DOT) {
                 consume();
-                Token field = consume();
+                const Token& field = consume();
                 if (peek().type == TOKEN_LPAREN) {
-                    ASTNode* method = new ASTNode();
-                    method->type = "MethodCall";
-                    method->name = field.value;
-                    method->left = n;
                     consume();
-                    if (peek().type != TOKEN_RPAREN) {
-                        method->args.push_back(parseExpression());
-                        while (peek().type == TOKEN_COMMA) { consume(); method->args.push_back(parseExpression()); }
-                    }
-                    consume();
-                    n = method;
+                    n = make(NodeKind::MethodCall, field.value, n);
+                    n->items = parseList(TOKEN_RPAREN);
                 } else {
-                    ASTNode* access = new ASTNode();
-                    access->type = "MemberAccess";
-                    access->name = field.value;
-                    access->left = n;
-                    n = access;
+                    n = make(NodeKind::MemberAccess, field.value, n);
                 }
             }
             if (peek().type == TOKEN_LBRACKET) {
                 consume();
                 ASTNode* idx = parseExpression();
                 consume();
-                ASTNode* access = new ASTNode();
-                access->type = "IndexAccess";
-                access->left = n;
-                access->right = idx;
-                n = access;
+                n = make(NodeKind::IndexAccess, Name(), n, idx);
             }
             if (peek().type == TOKEN_LPAREN && t.type != TOKEN_THIS) {
                 consume();
-                n->type = "Call";
+                n->kind = NodeKind::Call;
                 n->name = t.value;
-                if (peek().type != TOKEN_RPAREN) {
-                    n->args.push_back(parseExpression());
-                    while (peek().type == TOKEN_COMMA) { consume(); n->args.push_back(parseExpression()); }
-                }
-                consume();
-                return n;
+                n->items = parseList(TOKEN_RPAREN);
             }
             return n;
         }
-        return n;
+        return make(NodeKind::Null);
     }
     ASTNode* parseMultiplicative() {
         ASTNode* l = parsePrimary();
         while (peek().type == TOKEN_MUL || peek().type == TOKEN_DIV) {
-            Token op = consume();
-            ASTNode* n = new ASTNode();
-            n->type = "BinaryOp";
-            n->name = op.value;
-            n->left = l;
-            n->right = parsePrimary();
-            l = n;
+            Name op = consume().value;
+            l = make(NodeKind::BinaryOp, op, l, parsePrimary());
         }
         return l;
     }
     ASTNode* parseAdditive() {
         ASTNode* l = parseMultiplicative();
         while (peek().type == TOKEN_PLUS || peek().type == TOKEN_MINUS) {
-            Token op = consume();
-            ASTNode* n = new ASTNode();
-            n->type = "BinaryOp";
-            n->name = op.value;
-            n->left = l;
-            n->right = parseMultiplicative();
-            l = n;
+            Name op = consume().value;
+            l = make(NodeKind::BinaryOp, op, l, parseMultiplicative());
         }
         return l;
     }
     ASTNode* parseRelational() {
         ASTNode* l = parseAdditive();
         while (peek().type == TOKEN_LT || peek().type == TOKEN_GT) {
-            Token op = consume();
-            ASTNode* n = new ASTNode();
-            n->type = "BinaryOp";
-            n->name = op.value;
-            n->left = l;
-            n->right = parseAdditive();
-            l = n;
+            Name op = consume().value;
+            l = make(NodeKind::BinaryOp, op, l, parseAdditive());
         }
         return l;
     }
     ASTNode* parseEquality() {
         ASTNode* l = parseRelational();
         while (peek().type == TOKEN_EQ || peek().type == TOKEN_NEQ) {
-            Token op = consume();
-            ASTNode* n = new ASTNode();
-            n->type = "BinaryOp";
-            n->name = op.value;
-            n->left = l;
-            n->right = parseRelational();
-            l = n;
+            Name op = consume().value;
+            l = make(NodeKind::BinaryOp, op, l, parseRelational());
         }
         return l;
     }
     ASTNode* parseProgram() {
-        ASTNode* p = new ASTNode();
-        p->type = "Program";
+        std::vector<ASTNode*> decls;
         while (peek().type != TOKEN_EOF) {
             if (peek().type == TOKEN_STRUCT) {
                 consume();
-                Token n = consume();
+                ASTNode* s = make(NodeKind::Struct, consume().value);
                 consume();
-                ASTNode* s = new ASTNode();
-                s->type = "Struct";
-                s->name = n.value;
+                std::vector<Name> fields;
                 while (peek().type != TOKEN_RBRACE) {
-                    s->structFields.push_back(consume().value);
+                    fields.push_back(consume().value);
                     if (peek().type == TOKEN_COMMA) consume();
                 }
                 consume();
-                p->functions.push_back(s);
+                s->fields = arena.copy(fields);
+                decls.push_back(s);
             } else if (peek().type == TOKEN_FN) {
                 consume();
-                Token n = consume();
-                ASTNode* f = new ASTNode();
-                f->type = "Function";
+                const Token& n = consume();
+                ASTNode* f = make(NodeKind::Function, n.value);
                 if (peek().type == TOKEN_DOT) {
                     consume();
-                    Token methodName = consume();
-                    f->type = "Method";
-                    f->structName = n.value;
-                    f->name = methodName.value;
-                } else {
-                    f->name = n.value;
+                    f->kind = NodeKind::Method;
+                    f->fn.structName = n.value;
+                    f->name = consume().value;
                 }
                 consume();
+                std::vector<Name> params;
                 if (peek().type != TOKEN_RPAREN) {
-                    f->params.push_back(consume().value);
+                    params.push_back(consume().value);
                     while (peek().type == TOKEN_COMMA) {
                         consume();
-                        f->params.push_back(consume().value);
+                        params.push_back(consume().value);
                     }
                 }
                 consume();
+                f->fn.params = arena.copy(params);
+                f->fn.paramTypes = arena.copy(std::vector<MhsType>(params.size(), T_DYN));
                 f->right = parseBlock();
-                p->functions.push_back(f);
+                decls.push_back(f);
             } else pos++;
         }
+        ASTNode* p = make(NodeKind::Program);
+        p->items = arena.copy(decls);
         return p;
     }
 };
@@ -319,67 +455,47 @@ public:
 ASTNode* Parser::parseExpression() {
     ASTNode* l = parseEquality();
     while (peek().type == TOKEN_AND || peek().type == TOKEN_OR) {
-        Token op = consume();
-        ASTNode* n = new ASTNode();
-        n->type = "BinaryOp";
-        n->name = op.value;
-        n->left = l;
-        n->right = parseEquality();
-        l = n;
+        Name op = consume().value;
+        l = make(NodeKind::BinaryOp, op, l, parseEquality());
     }
     return l;
 }
 
 ASTNode* Parser::parseStatement() {
-    if (peek().type == TOKEN_BREAK) { consume(); ASTNode* n = new ASTNode(); n->type = "Break"; return n; }
-    if (peek().type == TOKEN_CONTINUE) { consume(); ASTNode* n = new ASTNode(); n->type = "Continue"; return n; }
-    if (peek().type == TOKEN_RETURN) { consume(); ASTNode* n = new ASTNode(); n->type = "Return"; n->left = parseExpression(); return n; }
+    if (peek().type == TOKEN_BREAK) { consume(); return make(NodeKind::Break); }
+    if (peek().type == TOKEN_CONTINUE) { consume(); return make(NodeKind::Continue); }
+    if (peek().type == TOKEN_RETURN) { consume(); return make(NodeKind::Return, Name(), parseExpression()); }
     if (peek().type == TOKEN_VAL || peek().type == TOKEN_VAR) {
         bool isMut = (consume().type == TOKEN_VAR);
-        Token name = consume();
-        ASTNode* n = new ASTNode();
-        n->type = "Declaration";
-        n->name = name.value;
-        n->isMutable = isMut;
+        const Token& name = consume();
         if (peek().type != TOKEN_ASSIGN) {
-            std::cout << "[MHS ERROR] Expected ':=' after '" << name.value << "'" << std::endl;
+            std::cout << "[MHS ERROR] Expected ':=' after '" << name.value << "' at line " << name.line << std::endl;
             exit(1);
         }
         consume();
-        n->left = parseExpression();
+        ASTNode* n = make(NodeKind::Declaration, name.value, parseExpression());
+        n->isMutable = isMut;
         return n;
     }
-    if (peek().type == TOKEN_ID && tokens[pos + 1].type == TOKEN_ASSIGN) {
-        Token n = consume();
+    if (peek().type == TOKEN_ID && peek(1).type == TOKEN_ASSIGN) {
+        Name name = consume().value;
         consume();
-        ASTNode* nd = new ASTNode();
-        nd->type = "Assignment";
-        nd->name = n.value;
-        nd->left = parseExpression();
-        return nd;
-    }
-    if (peek().type == TOKEN_ID && tokens[pos + 1].type == TOKEN_LBRACKET) {
-        Token name = consume();
+        return make(NodeKind::Assignment, name, parseExpression());
+    }
+    if (peek().type == TOKEN_ID && peek(1).type == TOKEN_LBRACKET) {
+        Name name = consume().value;
         consume();
         ASTNode* index = parseExpression();
         consume();
         if (peek().type == TOKEN_ASSIGN) {
             consume();
-            ASTNode* val = parseExpression();
-            ASTNode* nd = new ASTNode();
-            nd->type = "IndexAssignment";
-            nd->name = name.value;
-            nd->left = index;
-            nd->right = val;
-            return nd;
+            return make(NodeKind::IndexAssignment, name, index, parseExpression());
         }
     }
     if (peek().type == TOKEN_IF) {
         consume();
-        ASTNode* n = new ASTNode();
-        n->type = "If";
-        n->left = parseExpression();
-        n->right = parseBlock();
+        ASTNode* cond = parseExpression();
+        ASTNode* n = make(NodeKind::If, Name(), cond, parseBlock());
         if (peek().type == TOKEN_ELSE) {
             consume();
             n->elseBranch = parseBlock();
@@ -388,26 +504,33 @@ ASTNode* Parser::parseStatement() {
     }
     if (peek().type == TOKEN_WHILE) {
         consume();
-        ASTNode* nd = new ASTNode();
-        nd->type = "While";
-        nd->left = parseExpression();
-        nd->right = parseBlock();
-        return nd;
+        ASTNode* cond = parseExpression();
+        return make(NodeKind::While, Name(), cond, parseBlock());
+    }
+    if (peek().type == TOKEN_PARALLEL) {
+        consume();
+        ASTNode* n = peek().type == TOKEN_FOR ? parseStatement() : nullptr;
+        if (!n || n->kind != NodeKind::For) {
+            std::cout << "[MHS ERROR] Expected 'for i := a to b' after 'parallel'" << std::endl;
+            exit(1);
+        }
+        n->kind = NodeKind::ParallelFor;
+        return n;
     }
     if (peek().type == TOKEN_FOR) {
         consume();
-        Token varName = consume();
+        Name varName = consume().value;
+        if (peek().type == TOKEN_IN) {
+            consume();
+            ASTNode* iterable = parseExpression();
+            return make(NodeKind::ForEach, varName, iterable, parseBlock());
+        }
         consume(); // :=
         ASTNode* start = parseExpression();
         consume(); // to
         ASTNode* end = parseExpression();
-        ASTNode* body = parseBlock();
-        ASTNode* n = new ASTNode();
-        n->type = "For";
-        n->name = varName.value;
-        n->left = start;
-        n->right = end;
-        n->elseBranch = body;
+        ASTNode* n = make(NodeKind::For, varName, start, end);
+        n->elseBranch = parseBlock();
         return n;
     }
     if (peek().type == TOKEN_SWITCH) {
@@ -416,16 +539,17 @@ ASTNode* Parser::parseStatement() {
         ASTNode* cond = parseExpression();
         consume(); // )
         consume(); // {
-        ASTNode* sw = new ASTNode();
-        sw->type = "Switch";
-        sw->left = cond;
+        std::vector<ASTNode*> cases, blocks;
         while (peek().type == TOKEN_CASE) {
             consume();
-            sw->cases.push_back(parseExpression());
+            cases.push_back(parseExpression());
             consume(); // :
-            sw->caseBlocks.push_back(parseBlock());
+            blocks.push_back(parseBlock());
         }
         consume(); // }
+        ASTNode* sw = make(NodeKind::Switch, Name(), cond);
+        sw->sw.cases = arena.copy(cases);
+        sw->sw.blocks = arena.copy(blocks);
         return sw;
     }
     return parseExpression();
@@ -433,17 +557,753 @@ ASTNode* Parser::parseStatement() {
 
 ASTNode* Parser::parseBlock() {
     consume(); // {
-    ASTNode* b = new ASTNode();
-    b->type = "Block";
-    while (peek().type != TOKEN_RBRACE) b->statements.push_back(parseStatement());
+    std::vector<ASTNode*> statements;
+    while (peek().type != TOKEN_RBRACE && peek().type != TOKEN_EOF) statements.push_back(parseStatement());
     consume(); // }
+    ASTNode* b = make(NodeKind::Block);
+    b->items = arena.copy(statements);
     return b;
 }
 
+// Seeded FNV-1a; must stay identical to mhs_hash in the emitted runtime.
+static unsigned long long mhsHash(const std::string& s, unsigned long long seed) {
+    unsigned long long h = 1469598103934665603ULL ^ seed;
+    for (unsigned char c : s) { h ^= c; h *= 1099511628211ULL; }
+    return h ^ (h >> 32);
+}
+
+// Smallest power-of-two table and seed that put every key in its own slot.
+// Keys that still share a slot after the search are told apart by string compares.
+static std::pair<unsigned long long, unsigned long long> perfectHash(const std::vector<std::string>& keys) {
+    unsigned long long size = 1;
+    while (size < keys.size()) size <<= 1;
+    for (; size <= std::max<size_t>(8, keys.size() * 8); size <<= 1) {
+        for (unsigned long long seed = 0; seed < 256; seed++) {
+            std::set<unsigned long long> used;
+            bool ok = true;
+            for (auto& k : keys) if (!used.insert(mhsHash(k, seed) & (size - 1)).second) { ok = false; break; }
+            if (ok) return {seed, size - 1};
+        }
+    }
+    return {0, size / 2 - 1};
+}
+
+static MhsType joinTypes(MhsType a, MhsType b) {
+    if (a == T_UNKNOWN) return b;
+    if (b == T_UNKNOWN || a == b) return a;
+    return T_DYN;
+}
+
+// Result type of a binary operator; shared by inference and codegen so both agree.
+static MhsType binopType(std::string_view op, MhsType l, MhsType r) {
+    if (op == "+") {
+        if (l == T_STR || r == T_STR) return T_STR;
+        if (l == T_UNKNOWN || r == T_UNKNOWN) return T_UNKNOWN;
+        return (l == T_INT && r == T_INT) ? T_INT : T_DYN;
+    }
+    if (op == "-" || op == "*" || op == "/") {
+        if (l == T_UNKNOWN || r == T_UNKNOWN) return T_UNKNOWN;
+        return (l == T_INT && r == T_INT) ? T_INT : T_DYN;
+    }
+    return T_INT;
+}
+
+// sum_into / min_into / max_into fold an int into a variable declared outside a parallel for.
+static bool isReduction(std::string_view c) { return c == "sum_into" || c == "min_into" || c == "max_into"; }
+
+static bool contains(ASTNode* n, NodeKind kind) {
+    if (n->kind == kind) return true;
+    bool found = false;
+    forEachChild(n, [&](ASTNode* c) { found = found || contains(c, kind); });
+    return found;
+}
+
+static bool mentions(ASTNode* n, std::string_view name) {
+    if (n->kind == NodeKind::Variable && n->name == name) return true;
+    bool found = false;
+    forEachChild(n, [&](ASTNode* c) { found = found || mentions(c, name); });
+    return found;
+}
+
+// Names rebound anywhere under n: assignment targets and reduction variables.
+static void collectAssigned(ASTNode* n, std::set<std::string_view>& out) {
+    if (n->kind == NodeKind::Assignment) out.insert(n->name);
+    if (n->kind == NodeKind::Call && isReduction(n->name) && !n->items.empty() && n->items[0]->kind == NodeKind::Variable) out.insert(n->items[0]->name);
+    forEachChild(n, [&](ASTNode* c) { collectAssigned(c, out); });
+}
+
+static bool endsWithReturn(ASTNode* b) {
+    if (!b || b->items.empty()) return false;
+    ASTNode* last = b->items.back();
+    if (last->kind == NodeKind::Return) return true;
+    if (last->kind == NodeKind::Block) return endsWithReturn(last);
+    return last->kind == NodeKind::If && last->elseBranch && endsWithReturn(last->right) && endsWithReturn(last->elseBranch);
+}
+
+// Names declared at the current point of a walk over a function. Each block
+// pushes a frame and pops it on exit, undoing only its own declarations.
+class Scopes {
+    std::unordered_map<std::string_view, std::vector<VarInfo>> live;   // innermost binding last
+    std::vector<std::string_view> declared;
+    std::vector<size_t> frames;
+public:
+    void push() { frames.push_back(declared.size()); }
+    void pop() {
+        for (; declared.size() > frames.back(); declared.pop_back()) {
+            auto it = live.find(declared.back());
+            it->second.pop_back();
+            if (it->second.empty()) live.erase(it);
+        }
+        frames.pop_back();
+    }
+    void declare(std::string_view name, VarInfo v) { live[name].push_back(v); declared.push_back(name); }
+    bool has(std::string_view name) const { return live.count(name) != 0; }
+    const VarInfo* find(std::string_view name) const {
+        auto it = live.find(name);
+        return it == live.end() ? nullptr : &it->second.back();
+    }
+};
+
+// AST rewrites between parsing and type inference, enabled by -O1 (the default):
+// constant folding, propagation of 'val' bindings to literals and to other
+// variables, removal of dead branches, unreachable statements and uncalled
+// functions, and pooling of string literals into static constants.
+class Optimizer {
+    AstArena& arena;
+    Scopes scopes;
+    std::unordered_map<std::string_view, int> declarations;   // per function: how often each name is bound
+    std::set<std::string_view> assigned;                       // per function: names that are ever rebound
+    std::unordered_map<std::string_view, int> literalSlots;
+    static bool isLiteral(ASTNode* n) { return n->kind == NodeKind::Number || n->kind == NodeKind::String; }
+    static bool truthy(ASTNode* n) { return n->kind == NodeKind::Number ? n->numberValue != 0 : !n->name.empty(); }
+    static bool leavesBlock(ASTNode* n) { return n->kind == NodeKind::Return || n->kind == NodeKind::Break || n->kind == NodeKind::Continue; }
+    ASTNode* number(long long v) {
+        ASTNode* n = arena.node(NodeKind::Number);
+        n->numberValue = v;
+        return n;
+    }
+    ASTNode* string(std::string_view text) {
+        ASTNode* n = arena.node(NodeKind::String);
+        n->name = arena.text(text);
+        n->literal = -1;
+        return n;
+    }
+    ASTNode* clone(ASTNode* n) {
+        ASTNode* c = arena.node(n->kind);
+        *c = *n;
+        return c;
+    }
+    static std::string textOf(ASTNode* n) { return n->kind == NodeKind::Number ? std::to_string(n->numberValue) : std::string(n->name); }
+    // A name bound once and never reassigned denotes the same value everywhere in its scope.
+    bool stable(Name name) { return name == "this" || (declarations[name] == 1 && !assigned.count(name)); }
+    void countDeclarations(ASTNode* n) {
+        if (n->kind == NodeKind::Declaration || n->kind == NodeKind::For || n->kind == NodeKind::ParallelFor || n->kind == NodeKind::ForEach) declarations[n->name]++;
+        forEachChild(n, [&](ASTNode* c) { countDeclarations(c); });
+    }
+    // Folds an operator over two literals exactly as binop() would evaluate it at run
+    // time. Anything that would panic (overflow, division by zero) is left for run time.
+    ASTNode* fold(ASTNode* n) {
+        ASTNode *l = n->left, *r = n->right;
+        if (!isLiteral(l) || !isLiteral(r)) return n;
+        Name op = n->name;
+        if (op == "&&") return number(truthy(l) && truthy(r));
+        if (op == "||") return number(truthy(l) || truthy(r));
+        bool ints = l->kind == NodeKind::Number && r->kind == NodeKind::Number;
+        if (!ints) {
+            if (op == "+") return string(textOf(l) + textOf(r));
+            if (l->kind != NodeKind::String || r->kind != NodeKind::String) return n;
+            if (op == "==") return number(l->name == r->name);
+            if (op == "!=") return number(l->name != r->name);
+            if (op == "<") return number(l->name < r->name);
+            if (op == ">") return number(l->name > r->name);
+            return n;
+        }
+        long long a = l->numberValue, b = r->numberValue, v = 0;
+        if (op == "+") { if (__builtin_add_overflow(a, b, &v)) return n; }
+        else if (op == "-") { if (__builtin_sub_overflow(a, b, &v)) return n; }
+        else if (op == "*") { if (__builtin_mul_overflow(a, b, &v)) return n; }
+        else if (op == "/") {
+            if (b == 0 || (a == std::numeric_limits<long long>::min() && b == -1)) return n;
+            v = a / b;
+        }
+        else if (op == "<") v = a < b;
+        else if (op == ">") v = a > b;
+        else if (op == "==") v = a == b;
+        else if (op == "!=") v = a != b;
+        else return n;
+        return number(v);
+    }
+    ASTNode* expr(ASTNode* n) {
+        switch (n->kind) {
+            case NodeKind::Variable: {
+                const VarInfo* v = scopes.find(n->name);
+                return v && v->value ? clone(v->value) : n;
+            }
+            case NodeKind::BinaryOp:
+                n->left = expr(n->left);
+                n->right = expr(n->right);
+                return fold(n);
+            case NodeKind::Array: case NodeKind::Call: case NodeKind::MethodCall:
+                for (auto& a : n->items) a = expr(a);
+                break;
+            case NodeKind::Map:
+                for (auto& v : n->map.values) v = expr(v);
+                break;
+            default: break;
+        }
+        if (n->left) n->left = expr(n->left);
+        if (n->right) n->right = expr(n->right);
+        return n;
+    }
+    void loop(ASTNode* n, ASTNode* body) {
+        scopes.push();
+        scopes.declare(n->name, { true });
+        block(body);
+        scopes.pop();
+    }
+    // Returns the statement to keep in place of n, or nullptr to drop it.
+    ASTNode* stmt(ASTNode* n) {
+        switch (n->kind) {
+            case NodeKind::Declaration: {
+                n->left = expr(n->left);
+                ASTNode* value = nullptr;
+                if (!n->isMutable && !assigned.count(n->name)) {
+                    if (isLiteral(n->left) || (n->left->kind == NodeKind::Variable && stable(n->left->name))) value = n->left;
+                }
+                scopes.declare(n->name, { n->isMutable, value });
+                return n;
+            }
+            case NodeKind::Assignment: case NodeKind::Return:
+                n->left = expr(n->left);
+                return n;
+            case NodeKind::IndexAssignment:
+                n->left = expr(n->left);
+                n->right = expr(n->right);
+                return n;
+            case NodeKind::If: {
+                n->left = expr(n->left);
+                if (isLiteral(n->left)) {
+                    ASTNode* taken = truthy(n->left) ? n->right : n->elseBranch;
+                    return taken ? block(taken) : nullptr;
+                }
+                block(n->right);
+                if (n->elseBranch) block(n->elseBranch);
+                return n;
+            }
+            case NodeKind::While:
+                n->left = expr(n->left);
+                if (isLiteral(n->left) && !truthy(n->left)) return nullptr;
+                block(n->right);
+                return n;
+            case NodeKind::For: case NodeKind::ParallelFor:
+                n->left = expr(n->left);
+                n->right = expr(n->right);
+                loop(n, n->elseBranch);
+                return n;
+            case NodeKind::ForEach:
+                n->left = expr(n->left);
+                loop(n, n->right);
+                return n;
+            case NodeKind::Switch:
+                n->left = expr(n->left);
+                for (auto& c : n->sw.cases) c = expr(c);
+                for (auto b : n->sw.blocks) block(b);
+                return n;
+            case NodeKind::Block: return block(n);
+            case NodeKind::Break: case NodeKind::Continue: return n;
+            default: return expr(n);
+        }
+    }
+    ASTNode* block(ASTNode* b) {
+        scopes.push();
+        unsigned kept = 0;
+        for (ASTNode* s : b->items) {
+            if (!(s = stmt(s))) continue;
+            b->items[kept++] = s;
+            if (leavesBlock(s)) break;   // the rest of the block is unreachable
+        }
+        b->items.count = kept;
+        scopes.pop();
+        return b;
+    }
+    void function(ASTNode* f) {
+        declarations.clear();
+        assigned.clear();
+        for (auto p : f->fn.params) declarations[p]++;
+        countDeclarations(f->right);
+        collectAssigned(f->right, assigned);
+        scopes.push();
+        for (auto p : f->fn.params) scopes.declare(p, { true });
+        block(f->right);
+        scopes.pop();
+    }
+    void calls(ASTNode* n, std::set<std::string_view>& fns, std::set<std::string_view>& methods) {
+        if (n->kind == NodeKind::Call) fns.insert(n->name);
+        if (n->kind == NodeKind::MethodCall) methods.insert(n->name);
+        forEachChild(n, [&](ASTNode* c) { calls(c, fns, methods); });
+    }
+    // Keeps functions reachable from main; a method is kept if any reachable code
+    // calls a method of that name, since the receiver may be dynamic.
+    void dropUncalled(ASTNode* program) {
+        std::set<std::string_view> fns = { "main" }, methods;
+        std::set<ASTNode*> reached;
+        size_t before;
+        do {
+            before = reached.size();
+            for (auto f : program->items) {
+                bool live = f->kind == NodeKind::Function ? fns.count(f->name) != 0 : f->kind == NodeKind::Method && methods.count(f->name);
+                if (live && reached.insert(f).second) calls(f->right, fns, methods);
+            }
+        } while (reached.size() != before);
+        unsigned kept = 0;
+        for (ASTNode* f : program->items) if (f->kind == NodeKind::Struct || reached.count(f)) program->items[kept++] = f;
+        program->items.count = kept;
+    }
+    void pool(ASTNode* n) {
+        if (n->kind == NodeKind::String) {
+            auto [it, fresh] = literalSlots.try_emplace(n->name, (int)literals.size());
+            if (fresh) literals.push_back(n->name);
+            n->literal = it->second;
+            return;
+        }
+        if (n->kind == NodeKind::Switch) {   // case labels are compared as text, never materialized
+            pool(n->left);
+            for (auto b : n->sw.blocks) pool(b);
+            return;
+        }
+        forEachChild(n, [&](ASTNode* c) { pool(c); });
+    }
+public:
+    std::vector<Name> literals;                                // pooled string literals by slot
+    explicit Optimizer(AstArena& arena) : arena(arena) {}
+    void run(ASTNode* program) {
+        bool hasMain = false;
+        for (auto f : program->items) {
+            if (f->kind == NodeKind::Function || f->kind == NodeKind::Method) function(f);
+            hasMain = hasMain || (f->kind == NodeKind::Function && f->name == "main");
+        }
+        if (hasMain) dropUncalled(program);
+        for (auto f : program->items) if (f->kind != NodeKind::Struct) pool(f->right);
+    }
+};
+
+// Whole-program flow-insensitive inference. Every local, parameter and return
+// value gets the join of everything assigned to it, iterated to a fixpoint
+// over all functions. Int arrays are only unboxed when the variable never
+// escapes (it is only indexed, pushed to, measured or printed), since a
+// std::vector has value semantics and MHS arrays are shared references.
+class TypeInference {
+    std::map<std::string, ASTNode*> callables;
+    std::map<std::string, ASTNode*> methods;          // "Struct.method" -> node
+    std::map<std::string, std::map<std::string, MhsType>> vars;
+    std::map<std::string, MhsType> returns;
+    std::map<std::string, std::set<std::string>> escapes;
+    std::map<std::string, int> structIds;
+    std::vector<std::string> structNames;
+    std::vector<Span<Name>> structFields;
+    std::vector<std::vector<MhsType>> fieldTypes;     // join of constructor arguments per slot
+    std::string fn;
+    std::string fnStruct;                             // receiver struct of the method being walked
+    bool changed = false;
+    bool annotate = false;
+
+    static std::string keyOf(ASTNode* f) { return f->kind == NodeKind::Method ? f->fn.structName + "." + f->name : f->name; }
+    void scanEscapes(ASTNode* n, std::set<std::string>& esc) {
+        if (n->kind == NodeKind::Variable) { esc.insert(n->name); return; }
+        if (n->kind == NodeKind::IndexAccess && n->left->kind == NodeKind::Variable) { scanEscapes(n->right, esc); return; }
+        if (n->kind == NodeKind::Call && !n->items.empty() && n->items[0]->kind == NodeKind::Variable &&
+            (n->name == "push" || n->name == "len" || n->name == "at" || n->name == "print" || n->name == "join")) {
+            for (size_t i = 1; i < n->items.size(); i++) scanEscapes(n->items[i], esc);
+            return;
+        }
+        forEachChild(n, [&](ASTNode* c) { scanEscapes(c, esc); });
+    }
+    void assignVar(const std::string& f, const std::string& name, MhsType t) {
+        if (t == T_INTARR && escapes[f].count(name)) t = T_DYN;
+        MhsType& slot = vars[f][name];
+        MhsType j = joinTypes(slot, t);
+        if (j != slot) { slot = j; changed = true; }
+    }
+    void joinInto(MhsType& slot, MhsType t) {
+        MhsType j = joinTypes(slot, t);
+        if (j != slot) { slot = j; changed = true; }
+    }
+    MhsType varType(const std::string& name) {
+        if (name == "this") return structIds.count(fnStruct) ? structType(structIds[fnStruct]) : T_DYN;
+        auto& vs = vars[fn];
+        auto it = vs.find(name);
+        return it == vs.end() ? T_UNKNOWN : it->second;
+    }
+    MhsType infer(ASTNode* n) {
+        if (!n) return T_DYN;
+        MhsType t = inferNode(n);
+        if (annotate) n->vtype = t;
+        return t;
+    }
+    MhsType inferNode(ASTNode* n) {
+        switch (n->kind) {
+            case NodeKind::Number: return T_INT;
+            case NodeKind::String: return T_STR;
+            case NodeKind::Variable: return varType(n->name);
+            case NodeKind::Array: {
+                MhsType t = T_INTARR;
+                for (auto e : n->items) {
+                    MhsType et = infer(e);
+                    if (et == T_UNKNOWN && t == T_INTARR) t = T_UNKNOWN;
+                    else if (et != T_INT && et != T_UNKNOWN) t = T_DYN;
+                }
+                return t;
+            }
+            case NodeKind::IndexAccess: {
+                MhsType l = infer(n->left);
+                infer(n->right);
+                if (l == T_INTARR) return T_INT;
+                return l == T_UNKNOWN ? T_UNKNOWN : T_DYN;
+            }
+            case NodeKind::Call: {
+                std::vector<MhsType> at;
+                for (auto a : n->items) at.push_back(infer(a));
+                Name c = n->name;
+                if (c == "len" || c == "str_len" || c == "random_int" || c == "to_int") return T_INT;
+                if (c == "str_at" || c == "input" || c == "join") return T_STR;
+                if (c == "at" && at.size() == 2) return at[0] == T_INTARR ? T_INT : (at[0] == T_UNKNOWN ? T_UNKNOWN : T_DYN);
+                if (c == "push" && at.size() == 2 && n->items[0]->kind == NodeKind::Variable && at[1] != T_INT && at[1] != T_UNKNOWN)
+                    assignVar(fn, n->items[0]->name, T_DYN);
+                if (isReduction(c) && !n->items.empty() && n->items[0]->kind == NodeKind::Variable) assignVar(fn, n->items[0]->name, T_INT);
+                if (structIds.count(c)) {
+                    int id = structIds[c];
+                    for (size_t i = 0; i < fieldTypes[id].size(); i++)
+                        joinInto(fieldTypes[id][i], i < at.size() ? (at[i] == T_INTARR ? T_DYN : at[i]) : T_DYN);
+                    return structType(id);
+                }
+                if (!callables.count(c)) return T_DYN;
+                ASTNode* callee = callables[c];
+                for (size_t i = 0; i < at.size() && i < callee->fn.params.size(); i++)
+                    assignVar(c, callee->fn.params[i], at[i] == T_INTARR ? T_DYN : at[i]);
+                return returns[c];
+            }
+            case NodeKind::BinaryOp: {
+                MhsType l = infer(n->left);
+                MhsType r = infer(n->right);
+                return binopType(n->name, l, r);
+            }
+            case NodeKind::MethodCall: {
+                // A known receiver binds to one method; otherwise every method with this
+                // name and arity is a possible target and sees the arguments.
+                MhsType l = infer(n->left);
+                std::vector<MhsType> at;
+                for (auto a : n->items) { MhsType t = infer(a); at.push_back(t == T_INTARR ? T_DYN : t); }
+                if (l == T_UNKNOWN) return T_UNKNOWN;
+                for (auto& [k, m] : methods) {
+                    if (m->name != n->name || m->fn.params.size() != at.size()) continue;
+                    if (isStruct(l) && m->fn.structName != structNames[l - T_STRUCT]) continue;
+                    for (size_t i = 0; i < at.size(); i++) assignVar(k, m->fn.params[i], at[i]);
+                    if (isStruct(l)) return returns[k];
+                }
+                return T_DYN;
+            }
+            case NodeKind::MemberAccess: {
+                MhsType l = infer(n->left);
+                if (l == T_UNKNOWN) return T_UNKNOWN;
+                if (!isStruct(l)) return T_DYN;
+                auto& fields = structFields[l - T_STRUCT];
+                auto it = std::find(fields.begin(), fields.end(), n->name);
+                if (it == fields.end()) return T_DYN;
+                MhsType ft = fieldTypes[l - T_STRUCT][it - fields.begin()];
+                return (ft == T_UNKNOWN || ft == T_INT || isStruct(ft)) ? ft : T_DYN;
+            }
+            case NodeKind::For: case NodeKind::ParallelFor: {
+                infer(n->left);
+                infer(n->right);
+                assignVar(fn, n->name, T_INT);
+                infer(n->elseBranch);
+                return varType(n->name);
+            }
+            case NodeKind::ForEach: {
+                // Elements of an int array are ints and lines(...) yields strings; anything else is dynamic.
+                MhsType it = infer(n->left);
+                bool lines = n->left->kind == NodeKind::Call && n->left->name == "lines";
+                assignVar(fn, n->name, lines ? T_STR : it == T_INTARR ? T_INT : it == T_UNKNOWN ? T_UNKNOWN : T_DYN);
+                infer(n->right);
+                return varType(n->name);
+            }
+            case NodeKind::Return: {
+                MhsType t = infer(n->left);
+                if (returns.count(fn)) {
+                    MhsType j = joinTypes(returns[fn], t == T_INTARR ? T_DYN : t);
+                    if (j != returns[fn]) { returns[fn] = j; changed = true; }
+                }
+                return T_DYN;
+            }
+            case NodeKind::Declaration: case NodeKind::Assignment: {
+                assignVar(fn, n->name, infer(n->left));
+                return varType(n->name);
+            }
+            case NodeKind::IndexAssignment: {
+                infer(n->left);
+                MhsType v = infer(n->right);
+                if (v != T_INT && v != T_UNKNOWN) assignVar(fn, n->name, T_DYN);
+                return varType(n->name);
+            }
+            default: break;
+        }
+        forEachChild(n, [&](ASTNode* c) { infer(c); });
+        return T_DYN;
+    }
+    void walkAll(ASTNode* program) {
+        for (auto f : program->items) {
+            if (f->kind != NodeKind::Function && f->kind != NodeKind::Method) continue;
+            fn = keyOf(f);
+            fnStruct = f->kind == NodeKind::Method ? std::string(f->fn.structName) : "";
+            infer(f->right);
+        }
+    }
+public:
+    void run(ASTNode* program) {
+        for (auto f : program->items) {
+            if (f->kind == NodeKind::Struct) {
+                if (structIds.count(f->name)) continue;
+                structIds[f->name] = (int)structFields.size();
+                structNames.push_back(f->name);
+                structFields.push_back(f->fields);
+                fieldTypes.push_back(std::vector<MhsType>(f->fields.size(), T_UNKNOWN));
+                continue;
+            }
+            if (f->kind != NodeKind::Function && f->kind != NodeKind::Method) continue;
+            std::string k = keyOf(f);
+            auto& esc = escapes[k];
+            scanEscapes(f->right, esc);
+            for (auto& p : f->fn.params) { esc.insert(p); vars[k][p] = T_UNKNOWN; }
+            if (f->kind == NodeKind::Method) methods[k] = f;
+            else if (f->name != "main") callables[f->name] = f;
+            if (f->kind == NodeKind::Method || f->name != "main") returns[k] = endsWithReturn(f->right) ? T_UNKNOWN : T_DYN;
+        }
+        while (true) {
+            do { changed = false; walkAll(program); } while (changed);
+            bool promoted = false;
+            for (auto& [k, vs] : vars) for (auto& [name, t] : vs) if (t == T_UNKNOWN) { t = T_DYN; promoted = true; }
+            for (auto& [k, t] : returns) if (t == T_UNKNOWN) { t = T_DYN; promoted = true; }
+            for (auto& fts : fieldTypes) for (auto& t : fts) if (t == T_UNKNOWN) { t = T_DYN; promoted = true; }
+            if (!promoted) break;
+        }
+        annotate = true;
+        walkAll(program);
+        for (auto f : program->items) {
+            if (f->kind != NodeKind::Function && f->kind != NodeKind::Method) continue;
+            std::string k = keyOf(f);
+            f->vtype = returns.count(k) ? returns[k] : T_DYN;
+            for (size_t i = 0; i < f->fn.params.size(); i++) f->fn.paramTypes[i] = vars[k][f->fn.params[i]];
+        }
+    }
+};
+
+// Rejects anything in a parallel body that would race on a variable from outside
+// the loop: rebinding it, or mutating a container it holds. Containers are reached
+// through the variable itself or through locals that copied a reference to it
+// (aliases); both may only be written at the slot indexed by the loop variable,
+// which each iteration owns, and then only read there as well. They may never be
+// pushed to or handed to user functions or methods, which could do anything with them. A shared lines(...) stream has one
+// cursor, so it may not be iterated either. Leaving the loop with break or return
+// is rejected as well. Runs after TypeInference and before either back end, so a
+// program --interpret accepts also compiles.
+class ParallelChecker {
+    Scopes scopes;
+    std::set<std::string_view> functions;   // user functions, which may do anything with their arguments
+    static MhsType ty(ASTNode* n) { return (!n || n->vtype == T_UNKNOWN) ? T_DYN : n->vtype; }
+    [[noreturn]] static void parallelError(const std::string& msg) {
+        std::cout << "[MHS ERROR] " << msg << " inside 'parallel for'" << std::endl;
+        exit(1);
+    }
+    struct ParallelBody {
+        Name loopVar;
+        bool loopVarRebound = false;       // a[i] is only this iteration's slot if i is the loop's
+        bool writesSlots = false;          // some shared container is written at a[i]
+        std::set<std::string> locals, aliases;
+        std::set<ASTNode*> slotWrites;     // dynamic a[i] := x on shared containers, checked at run time
+        std::set<ASTNode*> sharedIters;    // for-in over a shared value that may turn out to be a stream
+    };
+    static bool holdsReference(ASTNode* n) { return ty(n) != T_INT && ty(n) != T_STR; }
+    bool isShared(Name v, const ParallelBody& p) { return (scopes.has(v) && !p.locals.count(v)) || p.aliases.count(v); }
+    // The first variable in n that holds a shared container, or nullptr.
+    ASTNode* sharedRef(ASTNode* n, const ParallelBody& p) {
+        if (n->kind == NodeKind::Variable) return isShared(n->name, p) && holdsReference(n) ? n : nullptr;
+        ASTNode* found = nullptr;
+        forEachChild(n, [&](ASTNode* c) { if (!found) found = sharedRef(c, p); });
+        return found;
+    }
+    // Locals that may hold a shared container. Repeated until stable, since a loop
+    // can alias a local after the statement that mutates it.
+    void collectAliases(ASTNode* n, ParallelBody& p, bool& grew) {
+        if (n->kind == NodeKind::ParallelFor) return;
+        auto alias = [&](Name v) { if (!isShared(v, p) && p.locals.count(v)) grew = p.aliases.insert(std::string(v)).second || grew; };
+        if (n->kind == NodeKind::Declaration || n->kind == NodeKind::For || n->kind == NodeKind::ForEach) {
+            p.locals.insert(n->name);
+            if (n->name == p.loopVar) p.loopVarRebound = true;
+        }
+        if ((n->kind == NodeKind::Declaration || n->kind == NodeKind::Assignment) && holdsReference(n) && sharedRef(n->left, p)) alias(n->name);
+        if (n->kind == NodeKind::ForEach && sharedRef(n->left, p)) alias(n->name);
+        if (n->kind == NodeKind::IndexAssignment && sharedRef(n->right, p)) alias(n->name);
+        if (n->kind == NodeKind::Call && n->name == "push" && n->items.size() == 2 && n->items[0]->kind == NodeKind::Variable && sharedRef(n->items[1], p)) alias(n->items[0]->name);
+        forEachChild(n, [&](ASTNode* c) { collectAliases(c, p, grew); });
+    }
+    void checkParallel(ASTNode* body, ParallelBody& p) {
+        std::set<std::string> outerLocals = p.locals;
+        for (bool grew = true; grew;) {
+            grew = false;
+            p.locals = outerLocals;
+            collectAliases(body, p, grew);
+        }
+        p.locals = outerLocals;
+        checkParallel(body, p, 0);
+        if (!p.writesSlots) return;
+        p.locals = outerLocals;
+        checkReads(body, p);
+    }
+    bool ownSlot(ASTNode* index, const ParallelBody& p) { return index->kind == NodeKind::Variable && index->name == p.loopVar && !p.loopVarRebound; }
+    // While iterations write their own slots, any other slot may be being replaced, and
+    // copying the old value out of it races with its release. Shared containers may then
+    // only be read at the loop variable's index, nested parallel loops included; this
+    // also covers containers that alias each other outside the loop.
+    void checkReads(ASTNode* n, ParallelBody& p) {
+        if (n->kind == NodeKind::Declaration || n->kind == NodeKind::For || n->kind == NodeKind::ForEach || n->kind == NodeKind::ParallelFor) p.locals.insert(n->name);
+        if (n->kind == NodeKind::Call && isReduction(n->name)) {
+            for (size_t k = 1; k < n->items.size(); k++) checkReads(n->items[k], p);
+            return;
+        }
+        if (n->kind == NodeKind::IndexAccess && n->left->kind == NodeKind::Variable && ownSlot(n->right, p)) return;
+        if (n->kind == NodeKind::Variable && isShared(n->name, p) && holdsReference(n))
+            parallelError("Cannot read shared variable '" + n->name + "' except at index '" + p.loopVar + "' while slots are written");
+        forEachChild(n, [&](ASTNode* c) { checkReads(c, p); });
+    }
+    void checkParallel(ASTNode* n, ParallelBody& p, int loops) {
+        if (n->kind == NodeKind::Declaration || n->kind == NodeKind::For || n->kind == NodeKind::ForEach) p.locals.insert(n->name);
+        if (n->kind == NodeKind::ParallelFor) { p.locals.insert(n->name); return; }   // checked when the walk reaches it
+        bool outer = scopes.has(n->name) && !p.locals.count(n->name);
+        if (n->kind == NodeKind::Assignment && outer) parallelError("Cannot assign to shared variable '" + n->name + "'; use sum_into/min_into/max_into");
+        if (n->kind == NodeKind::Return) parallelError("Cannot return");
+        if (n->kind == NodeKind::Break && loops == 0) parallelError("Cannot break");
+        if (n->kind == NodeKind::IndexAssignment && isShared(n->name, p)) {
+            if (!ownSlot(n->left, p)) parallelError("Cannot write to shared variable '" + n->name + "' except at index '" + p.loopVar + "'");
+            p.writesSlots = true;
+            if (ty(n) != T_INTARR) p.slotWrites.insert(n);
+        }
+        if (n->kind == NodeKind::Call && (n->name == "push" || n->name == "next_line") && !n->items.empty()) {
+            if (ASTNode* v = sharedRef(n->items[0], p)) parallelError("Cannot call " + n->name + " on shared variable '" + v->name + "'");
+        }
+        if (n->kind == NodeKind::Call && isReduction(n->name) && !n->items.empty() && n->items[0]->kind == NodeKind::Variable) {
+            Name v = n->items[0]->name;
+            if (!scopes.has(v) || p.locals.count(v)) parallelError(n->name + " needs a variable declared outside the loop, not '" + v + "'");
+        }
+        if (n->kind == NodeKind::ForEach && ty(n->left) != T_INTARR) {
+            if (ASTNode* v = sharedRef(n->left, p)) {
+                const VarInfo* info = p.locals.count(v->name) ? nullptr : scopes.find(v->name);
+                if (info && info->stream) parallelError("Cannot iterate over shared lines() stream '" + v->name + "'");
+                p.sharedIters.insert(n);
+            }
+        }
+        bool user = n->kind == NodeKind::MethodCall || (n->kind == NodeKind::Call && functions.count(n->name));
+        if (user) {
+            std::vector<ASTNode*> args(n->items.begin(), n->items.end());
+            if (n->kind == NodeKind::MethodCall) args.insert(args.begin(), n->left);
+            for (auto a : args) {
+                if (ASTNode* v = sharedRef(a, p)) parallelError("Cannot pass shared variable '" + v->name + "' to " + (n->kind == NodeKind::MethodCall ? "method '" : "function '") + n->name + "'");
+            }
+        }
+        ASTNode* body = n->kind == NodeKind::For ? n->elseBranch : (n->kind == NodeKind::While || n->kind == NodeKind::ForEach) ? n->right : nullptr;
+        forEachChild(n, [&](ASTNode* c) { checkParallel(c, p, loops + (c == body)); });
+    }
+    // Tracks what is declared where, as code generation will, and checks each parallel for against it.
+    void walk(ASTNode* n) {
+        switch (n->kind) {
+            case NodeKind::Function: case NodeKind::Method:
+                scopes.push();
+                if (n->kind == NodeKind::Method) scopes.declare("this", { true });
+                for (auto p : n->fn.params) scopes.declare(p, { true });
+                walk(n->right);
+                scopes.pop();
+                return;
+            case NodeKind::Block:
+                scopes.push();
+                for (auto c : n->items) walk(c);
+                scopes.pop();
+                return;
+            case NodeKind::Declaration: {
+                VarInfo info{ n->isMutable };
+                info.stream = n->left->kind == NodeKind::Call && n->left->name == "lines";
+                scopes.declare(n->name, info);
+                return;
+            }
+            case NodeKind::ParallelFor: {
+                ParallelBody body;
+                body.loopVar = n->name;
+                body.locals = { n->name };
+                checkParallel(n->elseBranch, body);
+                slotWrites.insert(body.slotWrites.begin(), body.slotWrites.end());
+                sharedIters.insert(body.sharedIters.begin(), body.sharedIters.end());
+                [[fallthrough]];
+            }
+            case NodeKind::For: case NodeKind::ForEach:
+                scopes.push();
+                scopes.declare(n->name, { true });
+                forEachChild(n, [&](ASTNode* c) { walk(c); });
+                scopes.pop();
+                return;
+            default: forEachChild(n, [&](ASTNode* c) { walk(c); }); return;
+        }
+    }
+public:
+    std::set<ASTNode*> slotWrites, sharedIters;   // see ParallelBody
+    void run(ASTNode* program) {
+        for (auto f : program->items) if (f->kind == NodeKind::Function && f->name != "main") functions.insert(f->name);
+        walk(program);
+    }
+};
+
+// Output buffer for generated code. Statements are appended a line at a time at
+// the current indentation; expressions are composed as strings and passed in whole.
+// Indentation stops growing at maxIndent levels so output stays linear in nesting.
+class Emitter {
+    static constexpr int maxIndent = 16;
+    std::string buf;
+    int depth = 0;
+    size_t lines = 0;
+public:
+    void line(std::string_view text) {
+        if (!text.empty()) buf.append(std::min(depth, maxIndent) * 4, ' ').append(text);
+        buf += '\n';
+        lines++;
+    }
+    void open(std::string_view text) { line(text); depth++; }
+    void close(std::string_view text = "}") { depth--; line(text); }
+    size_t lineCount() const { return lines; }
+    std::string take() { return std::move(buf); }
+};
+
 class Compiler {
-    std::set<std::string> structNames;
-    std::map<std::string, std::vector<std::string>> structDefs;
-    std::vector<std::string> methodDispatchers;
+    // Program-wide tables: set by the constructor and prepare(), then only read while
+    // bodies are generated, so --split workers use their owner's tables in place.
+    struct Tables {
+        bool lineBuffered = false, profile = false;
+        std::map<std::string, int> structIds;
+        std::vector<ASTNode*> structDefs;
+        std::map<std::string, ASTNode*> functionDefs;
+        std::map<std::string, ASTNode*> methodDefs;                    // "Struct.method" -> node
+        std::map<std::pair<std::string, size_t>, int> methodIds;        // (name, arity) -> vtable slot
+        bool parallel = false;                                         // the program has a parallel for, so the runtime is thread-safe
+        std::set<ASTNode*> slotWrites, sharedIters;                    // from ParallelChecker
+        std::vector<std::string> profileNames;                         // --profile: function ids in generated scopes
+        std::map<ASTNode*, int> profileIds;
+        std::map<std::string, unsigned long long> callCounts;          // --pgo: training-run calls by C++ function name
+        unsigned long long totalCalls = 0;
+        std::map<ASTNode*, std::set<std::string_view>> rebound;        // function -> names it rebinds
+        std::map<std::string, int> symbols;                            // interned map key -> mhs_sym_ slot
+        std::vector<ASTNode*> signatures;                              // functions and methods in declaration order
+        bool split = false;                                            // --split: declarations go in a shared header
+    };
+    Tables own;
+    const Tables& g;   // own, or the owning compiler's for a --split worker
+    Emitter out;
+    Scopes scopes;
     std::string escape_cpp(std::string s) {
         std::string out;
         for (char c : s) {
@@ -453,262 +1313,1944 @@ class Compiler {
         }
         return out;
     }
+    static MhsType ty(ASTNode* n) { return (!n || n->vtype == T_UNKNOWN) ? T_DYN : n->vtype; }
+    static std::string ctype(MhsType t) {
+        if (t == T_INT) return "long long";
+        if (t == T_STR) return "std::string";
+        if (t == T_INTARR) return "std::vector<long long>";
+        return "Value";
+    }
+    // Code emitted around an operand (pre + operand + post), or around both operands of
+    // a binary operator (pre + left + mid + right + post). Expressions append to one
+    // buffer, so a long expression is generated in linear time.
+    struct Wrap { std::string pre, mid, post; };
+    // Boxing happens only here, at the boundary between a typed and a dynamic context.
+    static Wrap coercion(MhsType from, MhsType to) {
+        if (from == T_UNKNOWN || isStruct(from)) from = T_DYN;
+        if (to == T_UNKNOWN || isStruct(to)) to = T_DYN;
+        Wrap w;
+        if (from == to) return w;
+        if (to != T_DYN) w.pre = "(";
+        if (from != T_DYN) { w.pre += from == T_INTARR ? "Value::from_ints(" : "Value("; w.post = ")"; }
+        if (to == T_INT) w.post += ").as_int()";
+        else if (to == T_STR) w.post += ").as_str()";
+        else if (to == T_INTARR) w.post += ").as_ints()";
+        return w;
+    }
+    static std::string coerce(const std::string& code, MhsType from, MhsType to) { Wrap w = coercion(from, to); return w.pre + code + w.post; }
+    void genAs(ASTNode* n, MhsType to, std::string& o) {
+        if (n->kind == NodeKind::String && n->literal >= 0 && to == T_DYN) { o += "mhs_lit_" + std::to_string(n->literal); return; }
+        if (n->kind == NodeKind::Array && ty(n) == T_INTARR && to == T_DYN) { arrayLiteral(n, false, o); return; }
+        Wrap w = coercion(ty(n), to);
+        o += w.pre;
+        expr(n, o);
+        o += w.post;
+    }
+    std::string genAs(ASTNode* n, MhsType to) { std::string o; genAs(n, to, o); return o; }
+    void arrayLiteral(ASTNode* n, bool ints, std::string& o) {
+        o += ints ? "std::vector<long long>{" : "mhs_array(";
+        for (size_t i = 0; i < n->items.size(); i++) {
+            genAs(n->items[i], ints ? T_INT : T_DYN, o);
+            if (i < n->items.size() - 1) o += ", ";
+        }
+        o += ints ? "}" : ")";
+    }
+    // C++ condition for a branch or loop test; typed comparisons skip the 0/1 round trip.
+    void test(ASTNode* n, std::string& o) {
+        if (n->kind == NodeKind::BinaryOp) {
+            MhsType lt = ty(n->left), rt = ty(n->right);
+            Name op = n->name;
+            if (op == "&&" || op == "||") { o += "("; test(n->left, o); o += " " + op + " "; test(n->right, o); o += ")"; return; }
+            bool cmp = op == "<" || op == ">" || op == "==" || op == "!=";
+            if (cmp && ((lt == T_INT && rt == T_INT) || (lt == T_STR && rt == T_STR))) {
+                o += "("; expr(n->left, o); o += " " + op + " "; expr(n->right, o); o += ")";
+                return;
+            }
+        }
+        Wrap w = condition(ty(n));
+        o += w.pre;
+        expr(n, o);
+        o += w.post;
+    }
+    std::string test(ASTNode* n) { std::string o; test(n, o); return o; }
+    static Wrap condition(MhsType t) {
+        if (t == T_INT) return {"(", "", ") != 0"};
+        if (t == T_STR) return {"!(", "", ").empty()"};
+        if (t == T_INTARR) return {"((void)(", "", "), false)"};
+        return {"(", "", ").is_true()"};
+    }
+    static std::string condition(const std::string& code, MhsType t) { Wrap w = condition(t); return w.pre + code + w.post; }
+    static Wrap stringOf(MhsType t) {
+        if (t == T_STR) return {};
+        if (t == T_INT) return {"std::to_string(", "", ")"};
+        Wrap w = coercion(t, T_DYN);
+        w.post += ".to_string()";
+        return w;
+    }
+    void stdString(ASTNode* n, std::string& o) {
+        if (ty(n) == T_STR) expr(n, o);
+        else { genAs(n, T_DYN, o); o += ".str()"; }
+    }
+    static Wrap binop(std::string_view op, MhsType lt, MhsType rt) {
+        auto around = [](const char* pre, const Wrap& l, const std::string& mid, const Wrap& r, const char* post) {
+            return Wrap{pre + l.pre, l.post + mid + r.pre, r.post + post};
+        };
+        MhsType t = binopType(op, lt, rt);
+        std::string spaced = " " + std::string(op) + " ";
+        if (op == "+" || op == "-" || op == "*" || op == "/") {
+            if (t == T_INT) return {op == "+" ? "mhs_add(" : op == "-" ? "mhs_sub(" : op == "*" ? "mhs_mul(" : "mhs_div(", ", ", ")"};
+            if (t == T_STR) return around("(", stringOf(lt), " + ", stringOf(rt), ")");
+            return around("(", coercion(lt, T_DYN), spaced, coercion(rt, T_DYN), ")");
+        }
+        if (op == "&&" || op == "||") return around("(long long)(", condition(lt), spaced, condition(rt), ")");
+        if ((lt == T_INT && rt == T_INT) || (lt == T_STR && rt == T_STR)) return {"(long long)(", spaced, ")"};
+        return around("(", coercion(lt, T_DYN), spaced, coercion(rt, T_DYN), ").iVal");
+    }
+    static std::string binop(std::string_view op, const std::string& l, MhsType lt, const std::string& r, MhsType rt) {
+        Wrap w = binop(op, lt, rt);
+        return w.pre + l + w.mid + r + w.post;
+    }
+    // 's := s + a + b' on a string or dynamic variable becomes in-place appends of a
+    // and b, provided neither piece reads s. Each append behaves exactly like the '+'.
+    bool appendChain(ASTNode* node, std::vector<ASTNode*>& pieces) {
+        if (ty(node) != T_STR && ty(node) != T_DYN) return false;
+        ASTNode* n = node->left;
+        for (; n->kind == NodeKind::BinaryOp && n->name == "+"; n = n->left) pieces.push_back(n->right);
+        if (pieces.empty() || n->kind != NodeKind::Variable || n->name != node->name) return false;
+        for (auto p : pieces) if (mentions(p, node->name)) return false;
+        std::reverse(pieces.begin(), pieces.end());
+        return true;
+    }
+    std::string piece(ASTNode* p) {
+        MhsType t = ty(p);
+        return t == T_INT || t == T_STR ? expr(p) : genAs(p, T_DYN);
+    }
+    void loopBody(ASTNode* body, int id) {
+        breakScopes.push_back(id);
+        emit(body);
+        breakScopes.pop_back();
+    }
+    void breakLabel(int id) { if (usedBreakLabels.count(id)) out.line("mhs_brk_" + std::to_string(id) + ":;"); }
+    void caseBody(ASTNode* block) {
+        breakScopes.push_back(-1);
+        emit(block);
+        breakScopes.pop_back();
+    }
+    void intSwitch(ASTNode* node, const std::string& cond, MhsType st) {
+        out.open(st == T_INT ? "switch (" + cond + ") {" : "if (" + cond + ".type == 1) switch (" + cond + ".iVal) {");
+        std::set<long long> seen;
+        for (size_t i = 0; i < node->sw.cases.size(); i++) {
+            if (!seen.insert(node->sw.cases[i]->numberValue).second) continue;
+            out.open("case " + std::to_string(node->sw.cases[i]->numberValue) + "LL: {");
+            caseBody(node->sw.blocks[i]);
+            out.close("} break;");
+        }
+        out.close();
+    }
+    void stringSwitch(ASTNode* node, const std::string& cond, MhsType st, const std::string& id) {
+        std::vector<std::string> keys;
+        std::vector<size_t> firstCase;
+        for (size_t i = 0; i < node->sw.cases.size(); i++) {
+            if (std::find(keys.begin(), keys.end(), node->sw.cases[i]->name) != keys.end()) continue;
+            keys.push_back(node->sw.cases[i]->name);
+            firstCase.push_back(i);
+        }
+        auto [seed, mask] = perfectHash(keys);
+        std::map<unsigned long long, std::vector<size_t>> slots;
+        for (size_t k = 0; k < keys.size(); k++) slots[mhsHash(keys[k], seed) & mask].push_back(k);
+        std::string view = "mhs_sv_" + id;
+        out.open(st == T_STR ? "{" : "if (" + cond + ".type == 2) {");
+        out.line("const std::string_view " + view + " = " + cond + (st == T_STR ? "" : ".str_view()") + ";");
+        out.open("switch (mhs_hash(" + view + ", " + std::to_string(seed) + "ULL) & " + std::to_string(mask) + "ULL) {");
+        for (auto& [slot, ks] : slots) {
+            out.line("case " + std::to_string(slot) + "ULL:");
+            for (size_t j = 0; j < ks.size(); j++) {
+                out.open((j ? "else if (" : "if (") + view + " == \"" + escape_cpp(keys[ks[j]]) + "\") {");
+                caseBody(node->sw.blocks[firstCase[ks[j]]]);
+                out.close();
+            }
+            out.line("break;");
+        }
+        out.close();
+        out.close();
+    }
+    // Literal map keys (map literals, m["key"], dynamic m.key) are interned once at
+    // startup; key is the text between the quotes of the C++ literal.
+    std::string symbol(const std::string& key) { return "mhs_sym_" + std::to_string(g.symbols.at(key)); }
+    void addSymbol(const std::string& key) { own.symbols.emplace(key, (int)own.symbols.size()); }
+    void collectSymbols(ASTNode* n) {
+        switch (n->kind) {
+            case NodeKind::Map: for (auto k : n->map.keys) addSymbol(escape_cpp(std::string(k))); break;
+            case NodeKind::IndexAccess:
+                if (ty(n->left) != T_INTARR && n->right->kind == NodeKind::String) addSymbol(escape_cpp(n->right->name));
+                break;
+            case NodeKind::IndexAssignment:
+                if (ty(n) != T_INTARR && n->left->kind == NodeKind::String) addSymbol(escape_cpp(n->left->name));
+                break;
+            case NodeKind::MemberAccess: if (!isStruct(ty(n->left))) addSymbol(n->name); break;
+            default: break;
+        }
+        forEachChild(n, [&](ASTNode* c) { collectSymbols(c); });
+    }
+    // Parameters the callee never rebinds are taken by const reference; the
+    // rest are copies the callee owns (and may move from).
+    std::string paramType(ASTNode* f, size_t i) {
+        MhsType t = f->fn.paramTypes[i];
+        if (t == T_INT || g.rebound.at(f).count(f->fn.params[i])) return ctype(t);
+        return "const " + ctype(t) + "&";
+    }
+    static std::string cppName(ASTNode* f) { return f->kind == NodeKind::Method ? f->fn.structName + "_" + f->name : std::string(f->name); }
+    static size_t nodeCount(ASTNode* n) {
+        size_t k = 1;
+        forEachChild(n, [&](ASTNode* c) { k += nodeCount(c); });
+        return k;
+    }
+    // --pgo: a function that took at least 1% of the training run's calls is marked hot,
+    // and declared inline when its body is small. Hints go on the line that declares the
+    // function, so line numbers and control flow still match the collected profile.
+    std::string hints(ASTNode* f) {
+        auto it = g.callCounts.find(cppName(f));
+        if (it == g.callCounts.end() || it->second < 1000 || it->second * 100 < g.totalCalls) return "";
+        return nodeCount(f->right) <= 40 ? "[[gnu::hot]] inline " : "[[gnu::hot]] ";
+    }
+    std::string forwardDecl(ASTNode* f) {
+        bool method = f->kind == NodeKind::Method;
+        std::string s = hints(f) + ctype(ty(f)) + " " + cppName(f) + "(" + (method ? "const Value&" : "");
+        for (size_t i = 0; i < f->fn.params.size(); i++) {
+            if (method || i > 0) s += ", ";
+            s += paramType(f, i);
+        }
+        return s + ");";
+    }
+    // Last-use analysis for std::move. A local is moved at a use that copies it
+    // (an argument, element or initializer; returns already move) when no later statement
+    // mentions it, nothing else in the same statement does, and no loop encloses
+    // the use without also enclosing the declaration.
+    struct Use { ASTNode* node; int stmt; int loops; bool copies; };
+    struct MoveScan {
+        std::map<std::string_view, std::vector<Use>> uses;
+        std::map<std::string_view, int> declLoops, declCount;
+        int stmt = 0;
+    };
+    void declareLocal(MoveScan& m, Name name, int loops) { m.declLoops[name] = loops; m.declCount[name]++; }
+    void scanUses(ASTNode* n, MoveScan& m, int loops, bool copies) {
+        if (!n) return;
+        auto mention = [&](Name name) { m.uses[name].push_back({nullptr, m.stmt, loops, false}); };
+        switch (n->kind) {
+            case NodeKind::Variable: m.uses[n->name].push_back({n, m.stmt, loops, copies}); return;
+            case NodeKind::Block:
+                for (auto st : n->items) { m.stmt++; scanUses(st, m, loops, false); }
+                return;
+            case NodeKind::Declaration:
+                scanUses(n->left, m, loops, true);
+                declareLocal(m, n->name, loops);
+                return;
+            case NodeKind::Assignment:
+                mention(n->name);
+                scanUses(n->left, m, loops, true);
+                return;
+            case NodeKind::IndexAssignment:
+                mention(n->name);
+                scanUses(n->left, m, loops, false);
+                scanUses(n->right, m, loops, true);
+                return;
+            case NodeKind::For: case NodeKind::ParallelFor: case NodeKind::ForEach:
+                scanUses(n->left, m, loops, false);
+                if (n->kind != NodeKind::ForEach) scanUses(n->right, m, loops, false);
+                declareLocal(m, n->name, loops + 1);
+                scanUses(n->kind == NodeKind::ForEach ? n->right : n->elseBranch, m, loops + 1, false);
+                return;
+            case NodeKind::While:
+                scanUses(n->left, m, loops + 1, false);
+                scanUses(n->right, m, loops + 1, false);
+                return;
+            case NodeKind::Array:
+                for (auto e : n->items) scanUses(e, m, loops, true);
+                return;
+            case NodeKind::Map:
+                for (auto v : n->map.values) scanUses(v, m, loops, true);
+                return;
+            case NodeKind::MethodCall:
+                scanUses(n->left, m, loops, false);
+                for (auto a : n->items) scanUses(a, m, loops, true);
+                return;
+            case NodeKind::Call: {
+                bool user = g.functionDefs.count(n->name) || g.structIds.count(n->name);
+                for (size_t i = 0; i < n->items.size(); i++) scanUses(n->items[i], m, loops, user || (n->name == "push" && i == 1));
+                return;
+            }
+            default: forEachChild(n, [&](ASTNode* c) { scanUses(c, m, loops, false); });
+        }
+    }
+    void markMoves(ASTNode* f) {
+        MoveScan m;
+        for (size_t i = 0; i < f->fn.params.size(); i++) {
+            declareLocal(m, f->fn.params[i], 0);
+            if (paramType(f, i)[0] == 'c') m.declCount[f->fn.params[i]]++;   // const& parameters cannot be moved from
+        }
+        scanUses(f->right, m, 0, false);
+        movedLocals.clear();
+        for (auto& [name, us] : m.uses) {
+            const Use& last = us.back();
+            if (!last.node || !last.copies || m.declCount[name] != 1 || last.loops != m.declLoops[name]) continue;
+            if (ty(last.node) == T_INT || name == "this") continue;
+            if (us.size() > 1 && us[us.size() - 2].stmt == last.stmt) continue;
+            last.node->moveOut = true;
+            movedLocals.insert(name);
+        }
+    }
+    // Per-struct method table indexed by (name, arity) slot. Thunks unbox the
+    // argument array into the method's typed parameters.
+    void vtable(ASTNode* st) {
+        std::vector<std::string> slots(g.methodIds.size(), "nullptr");
+        for (auto& [key, m] : g.methodDefs) {
+            if (m->fn.structName != st->name) continue;
+            std::string name = cppName(m);
+            std::string call = name + "(self";
+            for (size_t i = 0; i < m->fn.params.size(); i++) call += ", " + coerce("a[" + std::to_string(i) + "]", T_DYN, m->fn.paramTypes[i]);
+            out.line("static Value mhs_thunk_" + name + "(const Value& self, const Value* a) { (void)a; return " + coerce(call + ")", ty(m), T_DYN) + "; }");
+            slots[g.methodIds.at({m->name, m->fn.params.size()})] = "mhs_thunk_" + name;
+        }
+        std::string s = "const MhsMethodFn mhs_vtable_" + st->name + "[] = {";
+        for (size_t i = 0; i < slots.size(); i++) s += (i ? ", " : "") + slots[i];
+        out.line(s + "};");
+    }
 public:
-    std::string generate(ASTNode* node, std::map<std::string, VarInfo>& scope) {
-        if (!node) return "";
-        if (node->type == "Break") return "break;";
-        if (node->type == "Continue") return "continue;";
-        if (node->type == "Null") return "Value()";
-        if (node->type == "Number") return "Value(" + std::to_string(node->numberValue) + ")";
-        if (node->type == "String") return "Value(std::string(\"" + escape_cpp(node->stringValue) + "\"))";
-        if (node->type == "Variable") {
-            if (node->name == "this") return "var_this";
-            return "var_" + node->name;
-        }
-        if (node->type == "Array") {
-            std::string s = "Value::make_array({";
-            for (size_t i = 0; i < node->arrayElements.size(); i++) {
-                s += generate(node->arrayElements[i], scope);
-                if (i < node->arrayElements.size() - 1) s += ", ";
-            }
-            s += "})";
-            return s;
-        }
-        if (node->type == "Map") {
-            std::string s = "Value::make_map({";
-            for (size_t i = 0; i < node->mapEntries.size(); i++) {
-                s += "{\"" + node->mapEntries[i].first + "\", " + generate(node->mapEntries[i].second, scope) + "}";
-                if (i < node->mapEntries.size() - 1) s += ", ";
-            }
-            s += "})";
-            return s;
-        }
-        if (node->type == "IndexAccess") return generate(node->left, scope) + ".at(" + generate(node->right, scope) + ")";
-        if (node->type == "MemberAccess") return generate(node->left, scope) + ".get_safe(\"" + node->name + "\")";
-        if (node->type == "MethodCall") {
-            std::string obj = generate(node->left, scope);
-            std::string args = "std::vector<Value>{";
-            for (size_t i = 0; i < node->args.size(); i++) {
-                args += generate(node->args[i], scope);
-                if (i < node->args.size() - 1) args += ", ";
-            }
-            args += "}";
-            return "mhs_dispatch_method(" + obj + ", \"" + node->name + "\", " + args + ")";
-        }
-        if (node->type == "Call") {
-            if (node->name == "print") return "std::cout << " + generate(node->args[0], scope) + " << std::endl";
-            if (node->name == "read_file") return "Value(std_read_file(" + generate(node->args[0], scope) + ".sVal))";
-            if (node->name == "write_file") return "Value(std_write_file(" + generate(node->args[0], scope) + ".sVal, " + generate(node->args[1], scope) + ".sVal))";
-            if (node->name == "len") return "Value((int)" + generate(node->args[0], scope) + ".len())";
-            if (node->name == "push") {
-                return generate(node->args[0], scope) + ".array_push(" + generate(node->args[1], scope) + ")";
-            }
-            if (node->name == "at") return generate(node->args[0], scope) + ".at(" + generate(node->args[1], scope) + ".iVal)";
-            if (node->name == "str_len") return "Value((int)" + generate(node->args[0], scope) + ".sVal.length())";
-            if (node->name == "str_at") return "Value(std::string(1, " + generate(node->args[0], scope) + ".sVal[" + generate(node->args[1], scope) + ".iVal]))";
-            if (node->name == "random_int") {
-                return "Value(std_random(0, " + generate(node->args[0], scope) + ".iVal - 1))";
-            }
-            if (node->name == "input") {
-                if (node->args.empty()) {
-                    return "Value(std_input())";
-                } else {
-                    return "Value(std_input(" + generate(node->args[0], scope) + ".sVal))";
-                }
-            }
-            if (node->name == "to_int") {
-                return "Value(std_to_int(" + generate(node->args[0], scope) + ".sVal))";
-            }
-            if (structNames.count(node->name)) {
-                std::string s = "Value::make_struct(\"" + node->name + "\", {";
-                for (size_t i = 0; i < node->args.size(); i++) {
-                    s += generate(node->args[i], scope);
-                    if (i < node->args.size() - 1) s += ", ";
-                }
-                s += "})";
-                return s;
-            }
-            std::string s = node->name + "(";
-            for (size_t i = 0; i < node->args.size(); i++) {
-                s += generate(node->args[i], scope);
-                if (i < node->args.size() - 1) s += ", ";
-            }
-            s += ")";
-            return s;
-        }
-        if (node->type == "BinaryOp") {
-            std::string l = generate(node->left, scope);
-            std::string r = generate(node->right, scope);
-            if (node->name == "+") return "(" + l + " + " + r + ")";
-            if (node->name == "*") return "(" + l + " * " + r + ")";
-            if (node->name == "==") return "(" + l + " == " + r + ")";
-            if (node->name == ">") return "(" + l + " > " + r + ")";
-            if (node->name == "<") return "(" + l + " < " + r + ")";
-            if (node->name == "&&") return "(" + l + " && " + r + ")";
-            if (node->name == "||") return "(" + l + " || " + r + ")";
-            return "(" + l + " " + node->name + " " + r + ")";
-        }
-        if (node->type == "If") {
-            std::string s = "if ((" + generate(node->left, scope) + ").is_true()) {\n" + generate(node->right, scope) + "}\n";
-            if (node->elseBranch) s += "else {\n" + generate(node->elseBranch, scope) + "}\n";
-            return s;
-        }
-        if (node->type == "While") return "while ((" + generate(node->left, scope) + ").is_true()) {\n" + generate(node->right, scope) + "}\n";
-        if (node->type == "For") {
-            std::string var = "var_" + node->name;
-            scope[node->name] = { true };
-            return "for (Value " + var + " = " + generate(node->left, scope) + "; (" + var + " < " + generate(node->right, scope) + ").is_true() || (" + var + " == " + generate(node->right, scope) + ").is_true(); " + var + " = " + var + " + Value(1)) {\n" + generate(node->elseBranch, scope) + "}\n";
-        }
-        if (node->type == "Switch") {
-            std::string cond = generate(node->left, scope);
-            std::string s = "";
-            for (size_t i = 0; i < node->cases.size(); i++) {
-                std::string check = "(" + cond + " == " + generate(node->cases[i], scope) + ").is_true()";
-                if (i == 0) s += "if (" + check + ") {\n" + generate(node->caseBlocks[i], scope) + "}\n";
-                else s += "else if (" + check + ") {\n" + generate(node->caseBlocks[i], scope) + "}\n";
-            }
-            return s;
-        }
-        if (node->type == "Return") return "return " + generate(node->left, scope) + ";";
-        if (node->type == "Declaration") {
-            scope[node->name] = { node->isMutable };
-            std::string qualifier = node->isMutable ? "" : "const ";
-            return qualifier + "Value var_" + node->name + " = " + generate(node->left, scope) + ";";
-        }
-        if (node->type == "Assignment") return "var_" + node->name + " = " + generate(node->left, scope) + ";";
-        if (node->type == "IndexAssignment") return "var_" + node->name + ".set(" + generate(node->left, scope) + ", " + generate(node->right, scope) + ")";
-        if (node->type == "Block") {
-            std::string s = "";
-            std::map<std::string, VarInfo> bs = scope;
-            for (auto st : node->statements) s += generate(st, bs) + ";\n";
-            return s;
-        }
-        if (node->type == "Struct") {
-            structNames.insert(node->name);
-            structDefs[node->name] = node->structFields;
-            return "";
-        }
-        if (node->type == "Function" || node->type == "Method") {
-            std::map<std::string, VarInfo> fs;
-            std::string cppName;
-            if (node->type == "Method") {
-                cppName = node->structName + "_" + node->name;
-                methodDispatchers.push_back("if (obj.sVal == \"" + node->structName + "\" && method == \"" + node->name + "\") return " + cppName + "(obj" + (node->params.empty() ? "" : ", ") + "args);");
+    Compiler(bool lineBuffered = false, bool profile = false, std::map<std::string, unsigned long long> callCounts = {}) : g(own) {
+        own.lineBuffered = lineBuffered;
+        own.profile = profile;
+        own.callCounts = std::move(callCounts);
+    }
+    Compiler(const Compiler&) = delete;
+    explicit Compiler(const Tables& shared) : g(shared) {}   // a --split worker
+    bool usesParallel() const { return g.parallel; }
+    size_t outputLines() const { return out.lineCount() + unitLines; }
+    // literals is the Optimizer's pool; String nodes refer to it by slot.
+    std::string generate(ASTNode* program, const std::vector<Name>& literals = {}) {
+        prepare(program);
+        declarations(literals);
+        for (auto f : program->items) definition(f);
+        tables();
+        return out.take();
+    }
+    // --split: a shared header (the first string) plus n translation units. Bodies are
+    // generated on n threads by workers that hold only per-function state and read
+    // this compiler's tables, which prepare() fixed. Units are contiguous runs of
+    // functions of about equal AST size; the first one also defines the method tables.
+    std::vector<std::string> generateUnits(ASTNode* program, const std::vector<Name>& literals, int n) {
+        own.split = true;
+        prepare(program);
+        declarations(literals);
+        std::vector<std::vector<ASTNode*>> parts(n);
+        std::vector<size_t> sizes;
+        size_t total = 0, done = 0;
+        for (auto f : program->items) total += sizes.emplace_back(f->kind == NodeKind::Struct ? 0 : nodeCount(f->right));
+        for (size_t i = 0; i < program->items.size(); i++) {
+            if (program->items[i]->kind == NodeKind::Struct) continue;
+            parts[std::min<size_t>(n - 1, done * n / total)].push_back(program->items[i]);
+            done += sizes[i];
+        }
+        std::deque<Compiler> workers;
+        for (int k = 0; k < n; k++) workers.emplace_back(g);
+        std::vector<std::thread> threads;
+        for (int k = 0; k < n; k++) {
+            threads.emplace_back([&, k] {
+                Compiler& w = workers[k];
+                for (auto f : parts[k]) w.definition(f);
+                if (k == 0) w.tables();
+            });
+        }
+        for (auto& t : threads) t.join();
+        std::vector<std::string> units = { out.take() };
+        for (auto& w : workers) {
+            unitLines += w.out.lineCount();
+            units.push_back(w.out.take());
+        }
+        return units;
+    }
+private:
+    std::string expr(ASTNode* node) { std::string o; expr(node, o); return o; }
+    void expr(ASTNode* node, std::string& o) {
+        switch (node->kind) {
+            case NodeKind::Null: o += "Value()"; return;
+            case NodeKind::Number:
+                // -9223372036854775808LL would negate a literal too big for long long.
+                if (node->numberValue == std::numeric_limits<long long>::min()) o += "(-9223372036854775807LL - 1)";
+                else o += std::to_string(node->numberValue) + "LL";
+                return;
+            case NodeKind::String:
+                if (node->literal >= 0) o += "mhs_str_" + std::to_string(node->literal);
+                else o += "std::string(\"" + escape_cpp(node->name) + "\")";
+                return;
+            case NodeKind::Variable: {
+                declared(node->name);
+                if (node->name == "this") o += "var_this";
+                else o += node->moveOut ? "std::move(var_" + node->name + ")" : "var_" + node->name;
+                return;
+            }
+            case NodeKind::Array: arrayLiteral(node, ty(node) == T_INTARR, o); return;
+            case NodeKind::Map: {
+                o += "mhs_map(";
+                for (size_t i = 0; i < node->map.keys.size(); i++) {
+                    o += symbol(escape_cpp(std::string(node->map.keys[i]))) + ", ";
+                    genAs(node->map.values[i], T_DYN, o);
+                    if (i < node->map.keys.size() - 1) o += ", ";
+                }
+                o += ")";
+                return;
+            }
+            case NodeKind::IndexAccess: {
+                if (ty(node->left) == T_INTARR) { o += "mhs_at("; expr(node->left, o); o += ", "; genAs(node->right, T_INT, o); o += ")"; return; }
+                genAs(node->left, T_DYN, o);
+                if (node->right->kind == NodeKind::String) { o += ".at_sym(" + symbol(escape_cpp(node->right->name)) + ")"; return; }
+                o += ".at("; genAs(node->right, T_DYN, o); o += ")";
+                return;
+            }
+            case NodeKind::MemberAccess: {
+                // A statically known struct reads its slot at a fixed index; anything else looks the name up.
+                MhsType lt = ty(node->left);
+                if (!isStruct(lt)) { genAs(node->left, T_DYN, o); o += std::string(".get_safe(\"") + node->name + "\", " + symbol(node->name) + ")"; return; }
+                auto& fields = g.structDefs[lt - T_STRUCT]->fields;
+                auto it = std::find(fields.begin(), fields.end(), node->name);
+                if (it == fields.end()) { o += "((void)"; expr(node->left, o); o += ", Value())"; return; }
+                o += "mhs_field("; expr(node->left, o); o += ", " + std::to_string(it - fields.begin()) + ")";
+                if (ty(node) == T_INT) o += ".iVal";
+                return;
+            }
+            case NodeKind::MethodCall: {
+                // Statically known receivers call the method directly; the rest index the
+                // receiver's vtable by the (name, arity) slot assigned at compile time.
+                MhsType lt = ty(node->left);
+                ASTNode* m = nullptr;
+                if (isStruct(lt)) {
+                    auto it = g.methodDefs.find(g.structDefs[lt - T_STRUCT]->name + "." + node->name);
+                    if (it != g.methodDefs.end() && it->second->fn.params.size() == node->items.size()) m = it->second;
+                }
+                if (m) {
+                    Wrap w = coercion(ty(m), ty(node));
+                    o += w.pre + m->fn.structName + "_" + m->name + "(";
+                    expr(node->left, o);
+                    for (size_t i = 0; i < node->items.size(); i++) { o += ", "; genAs(node->items[i], m->fn.paramTypes[i], o); }
+                    o += ")" + w.post;
+                    return;
+                }
+                auto id = g.methodIds.find({node->name, node->items.size()});
+                Wrap w = coercion(T_DYN, ty(node));
+                o += w.pre + "mhs_invoke(";
+                genAs(node->left, T_DYN, o);
+                o += ", " + (id == g.methodIds.end() ? "-1" : std::to_string(id->second));
+                for (auto a : node->items) { o += ", "; genAs(a, T_DYN, o); }
+                o += ")" + w.post;
+                return;
+            }
+            case NodeKind::Call: call(node, o); return;
+            case NodeKind::BinaryOp: {
+                // A left-nested chain (a + b + c + ...) is emitted in one loop instead of
+                // one level of recursion per operator.
+                std::vector<std::pair<ASTNode*, Wrap>> chain;
+                ASTNode* n = node;
+                for (; n->kind == NodeKind::BinaryOp; n = n->left) {
+                    MhsType lt = ty(n->left), rt = ty(n->right);
+                    Wrap c = coercion(binopType(n->name, lt, rt), ty(n)), b = binop(n->name, lt, rt);
+                    o += c.pre + b.pre;
+                    chain.push_back({n, {"", b.mid, b.post + c.post}});
+                }
+                expr(n, o);
+                for (size_t i = chain.size(); i-- > 0;) {
+                    o += chain[i].second.mid;
+                    expr(chain[i].first->right, o);
+                    o += chain[i].second.post;
+                }
+                return;
+            }
+            default: return;
+        }
+    }
+    void call(ASTNode* node, std::string& o) {
+        if (node->name == "print") {
+            o += g.parallel ? "mhs_print(" : "std::cout << ";
+            if (ty(node->items[0]) == T_INTARR) genAs(node->items[0], T_DYN, o);
+            else expr(node->items[0], o);
+            if (g.parallel) o += g.lineBuffered ? ", true)" : ", false)";
+            else o += g.lineBuffered ? " << std::endl" : " << '\\n'";
+            return;
+        }
+        if (node->name == "flush") { o += "mhs_flush()"; return; }
+        if (node->name == "read_file") { o += "std_read_file("; stdString(node->items[0], o); o += ")"; return; }
+        if (node->name == "write_file") {
+            ASTNode* data = node->items[1];
+            o += "Value(std_write_file(";
+            stdString(node->items[0], o);
+            o += ", ";
+            if (ty(data) == T_STR) { o += "std::string_view("; expr(data, o); o += ")"; }
+            else genAs(data, T_DYN, o);
+            o += "))";
+            return;
+        }
+        if (isReduction(node->name)) {
+            auto it = node->items.size() == 2 && node->items[0]->kind == NodeKind::Variable ? reductions.find({node->name, node->items[0]->name}) : reductions.end();
+            if (it == reductions.end()) {
+                std::cout << "[MHS ERROR] " << node->name << "(var, value) is only allowed inside 'parallel for'" << std::endl;
+                exit(1);
+            }
+            const std::string& acc = it->second.first;
+            if (node->name == "sum_into") o += acc + " = mhs_add(" + acc + ", ";
+            else o += acc + " = std::" + (node->name == "min_into" ? "min" : "max") + "(" + acc + ", ";
+            genAs(node->items[1], T_INT, o);
+            o += ")";
+            return;
+        }
+        if (node->name == "lines") { o += "std_lines("; stdString(node->items[0], o); o += ")"; return; }
+        if (node->name == "next_line") { genAs(node->items[0], T_DYN, o); o += ".next_line()"; return; }
+        if (node->name == "len") {
+            o += "(long long)";
+            if (ty(node->items[0]) == T_INTARR) { expr(node->items[0], o); o += ".size()"; }
+            else { genAs(node->items[0], T_DYN, o); o += ".len()"; }
+            return;
+        }
+        if (node->name == "push") {
+            if (ty(node->items[0]) == T_INTARR) { expr(node->items[0], o); o += ".push_back("; genAs(node->items[1], T_INT, o); }
+            else { genAs(node->items[0], T_DYN, o); o += ".array_push("; genAs(node->items[1], T_DYN, o); }
+            o += ")";
+            return;
+        }
+        if (node->name == "at") {
+            if (ty(node->items[0]) == T_INTARR) { o += "mhs_at("; expr(node->items[0], o); o += ", "; genAs(node->items[1], T_INT, o); }
+            else { genAs(node->items[0], T_DYN, o); o += ".at("; genAs(node->items[1], T_DYN, o); }
+            o += ")";
+            return;
+        }
+        if (node->name == "str_len") {
+            o += "(long long)";
+            if (ty(node->items[0]) == T_STR) { expr(node->items[0], o); o += ".length()"; }
+            else { genAs(node->items[0], T_DYN, o); o += ".str_view().length()"; }
+            return;
+        }
+        if (node->name == "str_at") {
+            o += "mhs_str_at(";
+            if (ty(node->items[0]) == T_STR) expr(node->items[0], o);
+            else { genAs(node->items[0], T_DYN, o); o += ".str_view()"; }
+            o += ", ";
+            genAs(node->items[1], T_INT, o);
+            o += ")";
+            return;
+        }
+        if (node->name == "join") {
+            ASTNode* arr = node->items[0];
+            o += "std_join(";
+            if (ty(arr) == T_INTARR) expr(arr, o);
+            else genAs(arr, T_DYN, o);
+            o += ", ";
+            if (node->items.size() > 1) stdString(node->items[1], o);
+            else o += "\"\"";
+            o += ")";
+            return;
+        }
+        if (node->name == "random_int") {
+            o += "(long long)std_random(0, ";
+            genAs(node->items[0], T_INT, o);
+            o += " - 1)";
+            return;
+        }
+        if (node->name == "input") {
+            if (node->items.empty()) {
+                o += "std_input()";
             } else {
-                if (node->name == "main") return "Value mhs_main() {\n" + generate(node->right, fs) + "return Value(0);\n}\n";
-                cppName = node->name;
-            }
-            std::string args = "";
-            if (node->type == "Method") {
-                args += "Value var_this";
-                fs["this"] = { true };
-                if (!node->params.empty()) args += ", ";
-            }
-            for (size_t i = 0; i < node->params.size(); i++) {
-                args += "Value var_" + node->params[i];
-                fs[node->params[i]] = { true };
-                if (i < node->params.size() - 1) args += ", ";
-            }
-            return "\nValue " + cppName + "(" + args + ") {\n" + generate(node->right, fs) + "}\n";
-        }
-        if (node->type == "Program") {
-            std::string s = "";
-            std::map<std::string, VarInfo> e;
-            for (auto f : node->functions) {
-                if (f->type == "Function" && f->name != "main") {
-                    s += "Value " + f->name + "(";
-                    for (size_t i = 0; i < f->params.size(); i++) {
-                        s += "Value";
-                        if (i < f->params.size() - 1) s += ", ";
+                o += "std_input(";
+                stdString(node->items[0], o);
+                o += ")";
+            }
+            return;
+        }
+        if (node->name == "to_int") { o += "std_to_int("; stdString(node->items[0], o); o += ")"; return; }
+        if (g.structIds.count(node->name)) {
+            ASTNode* def = g.structDefs[g.structIds.at(node->name)];
+            if (node->items.size() > def->fields.size()) {
+                std::cout << "[MHS ERROR] Struct '" << node->name << "' has " << def->fields.size() << " fields but got " << node->items.size() << " values" << std::endl;
+                exit(1);
+            }
+            o += "mhs_new_" + node->name + "(";
+            for (size_t i = 0; i < def->fields.size(); i++) {
+                if (i < node->items.size()) genAs(node->items[i], T_DYN, o);
+                else o += "Value()";
+                if (i < def->fields.size() - 1) o += ", ";
+            }
+            o += ")";
+            return;
+        }
+        ASTNode* callee = g.functionDefs.count(node->name) ? g.functionDefs.at(node->name) : nullptr;
+        o += node->name + "(";
+        for (size_t i = 0; i < node->items.size(); i++) {
+            MhsType want = (callee && i < callee->fn.paramTypes.size()) ? callee->fn.paramTypes[i] : T_DYN;
+            genAs(node->items[i], want, o);
+            if (i < node->items.size() - 1) o += ", ";
+        }
+        o += ")";
+    }
+    void emit(ASTNode* node) {
+        if (!node) return;
+        switch (node->kind) {
+            case NodeKind::Break: {
+                // Inside a C++ switch a plain break would only leave the switch.
+                if (breakScopes.empty() || breakScopes.back() >= 0) { out.line("break;"); return; }
+                for (auto it = breakScopes.rbegin(); it != breakScopes.rend(); ++it) {
+                    if (*it < 0) continue;
+                    usedBreakLabels.insert(*it);
+                    out.line("goto mhs_brk_" + std::to_string(*it) + ";");
+                    return;
+                }
+                out.line("break;");
+                return;
+            }
+            case NodeKind::Continue: out.line("continue;"); return;
+            case NodeKind::If: {
+                out.open("if (" + test(node->left) + ") {");
+                emit(node->right);
+                if (node->elseBranch) {
+                    out.close();
+                    out.open("else {");
+                    emit(node->elseBranch);
+                }
+                out.close();
+                return;
+            }
+            case NodeKind::While: {
+                int id = tempCounter++;
+                out.open("while (" + test(node->left) + ") {");
+                loopBody(node->right, id);
+                out.close();
+                breakLabel(id);
+                return;
+            }
+            case NodeKind::For: {
+                // Bounds are evaluated once into a native counter; the body gets its own copy of
+                // the loop variable, boxed only if inference could not keep it an int. The end is
+                // inclusive, so in general the test runs after the body on an unsigned counter: a
+                // loop up to the largest int stops there instead of overflowing, and 'continue'
+                // still steps. A literal end below that keeps the plain form g++ optimizes best.
+                int loopId = tempCounter++;
+                std::string id = std::to_string(loopId);
+                std::string counter = "mhs_for_" + id, end = "mhs_end_" + id;
+                scopes.push();
+                scopes.declare(node->name, { true });
+                std::string var = ctype(ty(node)) + " var_" + node->name + " = ";
+                if (node->right->kind == NodeKind::Number && node->right->numberValue < std::numeric_limits<long long>::max()) {
+                    out.open("for (long long " + counter + " = " + genAs(node->left, T_INT) + ", " + end + " = " + std::to_string(node->right->numberValue + 1) + "LL; " + counter + " < " + end + "; ++" + counter + ") {");
+                    out.line(var + coerce(counter, T_INT, ty(node)) + ";");
+                    loopBody(node->elseBranch, loopId);
+                    out.close();
+                    breakLabel(loopId);
+                    scopes.pop();
+                    return;
+                }
+                out.open("{");
+                out.line("unsigned long long " + counter + " = (unsigned long long)" + genAs(node->left, T_INT) + ";");
+                out.line("const long long " + end + " = " + genAs(node->right, T_INT) + ";");
+                out.open("if ((long long)" + counter + " <= " + end + ") do {");
+                out.line(var + coerce("(long long)" + counter, T_INT, ty(node)) + ";");
+                loopBody(node->elseBranch, loopId);
+                out.close("} while (" + counter + "++ != (unsigned long long)" + end + ");");
+                breakLabel(loopId);
+                out.close();
+                scopes.pop();
+                return;
+            }
+            case NodeKind::ParallelFor: {
+                // Chunks of the range run on the pool; each chunk folds its reductions into
+                // locals and merges them into the outer variables once, under a lock.
+                int loopId = tempCounter++;
+                std::string id = std::to_string(loopId);
+                auto saved = reductions;
+                reductions.clear();
+                std::vector<ASTNode*> targets;
+                collectReductions(node->elseBranch, targets);
+                for (auto t : targets) {
+                    auto key = std::make_pair(std::string(t->name), std::string(t->items[0]->name));
+                    if (!reductions.count(key)) reductions[key] = { "mhs_red_" + id + "_" + std::to_string(reductions.size()), t->items[0] };
+                }
+                std::string from = "mhs_from_" + id, to = "mhs_to_" + id, counter = "mhs_for_" + id;
+                scopes.push();
+                scopes.declare(node->name, { true });
+                out.open("mhs_parallel_for(" + genAs(node->left, T_INT) + ", " + genAs(node->right, T_INT) + ", [&](long long " + from + ", long long " + to + ") {");
+                std::vector<std::string> merge;
+                for (auto& [key, red] : reductions) {
+                    const std::string& acc = red.first;
+                    std::string outer = expr(red.second), cur = coerce(outer, ty(red.second), T_INT);
+                    out.line("long long " + acc + " = " + (key.first == "sum_into" ? "0" : key.first == "min_into" ? "std::numeric_limits<long long>::max()" : "std::numeric_limits<long long>::min()") + ";");
+                    std::string folded = key.first == "sum_into" ? "mhs_add(" + cur + ", " + acc + ")" : "std::" + std::string(key.first == "min_into" ? "min" : "max") + "(" + cur + ", " + acc + ")";
+                    merge.push_back(outer + " = " + coerce(folded, T_INT, ty(red.second)) + ";");
+                }
+                out.line("unsigned long long " + counter + " = (unsigned long long)" + from + ";");
+                out.open("do {");
+                out.line(ctype(ty(node)) + " var_" + node->name + " = " + coerce("(long long)" + counter, T_INT, ty(node)) + ";");
+                loopBody(node->elseBranch, loopId);
+                out.close("} while (" + counter + "++ != (unsigned long long)" + to + ");");
+                if (!merge.empty()) out.line("std::lock_guard<std::mutex> mhs_lock_" + id + "(mhs_reduce_lock());");
+                for (auto& m : merge) out.line(m);
+                reductions = saved;
+                scopes.pop();
+                out.close("});");
+                return;
+            }
+            case NodeKind::ForEach: {
+                // Int arrays are walked by index so pushes in the body are seen; anything else
+                // goes through MhsCursor, which streams lines(...) without loading the file.
+                int loopId = tempCounter++;
+                std::string id = std::to_string(loopId);
+                scopes.push();
+                scopes.declare(node->name, { true });
+                std::string var = ctype(ty(node)) + " var_" + node->name + " = ";
+                out.open("{");
+                if (ty(node->left) == T_INTARR) {
+                    std::string arr = "mhs_in_" + id, k = "mhs_k_" + id;
+                    out.line("const std::vector<long long>& " + arr + " = " + expr(node->left) + ";");
+                    out.open("for (size_t " + k + " = 0; " + k + " < " + arr + ".size(); ++" + k + ") {");
+                    out.line(var + coerce(arr + "[" + k + "]", T_INT, ty(node)) + ";");
+                } else {
+                    std::string cur = "mhs_cur_" + id;
+                    std::string src = genAs(node->left, T_DYN);
+                    if (g.sharedIters.count(node)) src = "mhs_shared_iterable(" + src + ")";
+                    out.line("MhsCursor " + cur + "(" + src + ");");
+                    out.open("while (" + cur + ".next()) {");
+                    out.line(var + (ty(node) == T_STR ? "std::string(" + cur + ".text())" : coerce(cur + ".value()", T_DYN, ty(node))) + ";");
+                }
+                loopBody(node->right, loopId);
+                out.close();
+                breakLabel(loopId);
+                out.close();
+                scopes.pop();
+                return;
+            }
+            case NodeKind::Switch: {
+                // The scrutinee is evaluated exactly once. All-int cases become a C++ switch and
+                // all-string cases a switch over a perfect hash; anything else is an if/else chain.
+                std::string id = std::to_string(tempCounter++);
+                std::string cond = "mhs_sw_" + id;
+                MhsType st = ty(node->left);
+                out.open("{");
+                out.line("const " + ctype(st) + " " + cond + " = " + expr(node->left) + ";");
+                bool allInt = !node->sw.cases.empty(), allStr = !node->sw.cases.empty();
+                for (auto c : node->sw.cases) {
+                    allInt = allInt && c->kind == NodeKind::Number;
+                    allStr = allStr && c->kind == NodeKind::String;
+                }
+                if (allInt && (st == T_INT || st == T_DYN)) intSwitch(node, cond, st);
+                else if (allStr && (st == T_STR || st == T_DYN)) stringSwitch(node, cond, st, id);
+                else {
+                    for (size_t i = 0; i < node->sw.cases.size(); i++) {
+                        std::string check = condition(binop("==", cond, st, expr(node->sw.cases[i]), ty(node->sw.cases[i])), T_INT);
+                        out.open((i ? "else if (" : "if (") + check + ") {");
+                        emit(node->sw.blocks[i]);
+                        out.close();
                     }
-                    s += ");\n";
                 }
+                out.close();
+                return;
             }
-            for (auto f : node->functions) s += generate(f, e) + "\n";
-            s += "Value mhs_dispatch_method(Value obj, std::string method, std::vector<Value> args) {\n";
-            for (auto& disp : methodDispatchers) s += disp + "\n";
-            s += "std::cerr << \"[PANIC] Method not found\" << std::endl; exit(1);\n";
-            s += "return Value();\n}\n";
-            s += "Value Value::make_struct(std::string name, std::vector<Value> args) {\n";
-            s += "Value v; v.type = 3; v.sVal = name; v.members = std::make_shared<std::map<std::string, Value>>();\n";
-            for (auto const& [name, fields] : structDefs) {
-                s += "if (name == \"" + name + "\") { ";
-                for (size_t i = 0; i < fields.size(); i++) s += "(*v.members)[\"" + fields[i] + "\"] = args[" + std::to_string(i) + "]; ";
-                s += "}\n";
+            case NodeKind::Return: out.line("return " + genAs(node->left, ty(currentFunction)) + ";"); return;
+            case NodeKind::Declaration: {
+                scopes.declare(node->name, { node->isMutable });
+                MhsType vt = ty(node);
+                std::string qualifier = (node->isMutable || vt == T_INTARR || movedLocals.count(node->name)) ? "" : "const ";
+                out.line(qualifier + ctype(vt) + " var_" + node->name + " = " + genAs(node->left, vt) + ";");
+                return;
             }
-            s += "return v;\n}\n";
-            return s;
+            case NodeKind::Assignment: {
+                declared(node->name);
+                std::vector<ASTNode*> pieces;
+                if (appendChain(node, pieces)) {
+                    for (auto p : pieces) out.line("mhs_append(var_" + node->name + ", " + piece(p) + ");");
+                    return;
+                }
+                out.line("var_" + node->name + " = " + genAs(node->left, ty(node)) + ";");
+                return;
+            }
+            case NodeKind::IndexAssignment: {
+                declared(node->name);
+                if (ty(node) == T_INTARR) out.line("mhs_set(var_" + node->name + ", " + genAs(node->left, T_INT) + ", " + genAs(node->right, T_INT) + ");");
+                else if (node->left->kind == NodeKind::String) out.line("var_" + node->name + ".set_sym(" + symbol(escape_cpp(node->left->name)) + ", " + genAs(node->right, T_DYN) + ");");
+                else if (g.slotWrites.count(node)) out.line("mhs_set_slot(var_" + node->name + ", " + genAs(node->left, T_DYN) + ", " + genAs(node->right, T_DYN) + ");");
+                else out.line("var_" + node->name + ".set(" + genAs(node->left, T_DYN) + ", " + genAs(node->right, T_DYN) + ");");
+                return;
+            }
+            case NodeKind::Block: {
+                scopes.push();
+                for (auto st : node->items) {
+                    if (st->kind != NodeKind::Block) { emit(st); continue; }
+                    out.open("{");   // a branch the optimizer kept in place of its 'if'
+                    emit(st);
+                    out.close();
+                }
+                scopes.pop();
+                return;
+            }
+            case NodeKind::Struct: {
+                // Field names are kept only for dynamic lookups on receivers of unknown type.
+                std::string id = std::to_string(g.structIds.at(node->name));
+                std::string fields = "mhs_fields_" + node->name;
+                if (!node->fields.empty()) {
+                    std::string s = storage() + "const char* const " + fields + "[] = {";
+                    for (size_t i = 0; i < node->fields.size(); i++) s += std::string(i ? ", " : "") + "\"" + node->fields[i] + "\"";
+                    out.line(s + "};");
+                } else fields = "nullptr";
+                std::string vt = g.methodIds.empty() ? "nullptr" : "mhs_vtable_" + node->name;
+                if (!g.methodIds.empty()) out.line("extern const MhsMethodFn " + vt + "[];");
+                out.line(storage() + "const StructInfo mhs_struct_" + node->name + " = {\"" + node->name + "\", " + id + ", " + std::to_string(node->fields.size()) + ", " + fields + ", " + vt + "};");
+                std::string ctor = std::string(g.split ? "inline " : "") + "Value mhs_new_" + node->name + "(";
+                for (size_t i = 0; i < node->fields.size(); i++) ctor += std::string(i ? ", " : "") + "Value f" + std::to_string(i);
+                out.open(ctor + ") {");
+                out.line("Value v = Value::new_struct(&mhs_struct_" + node->name + ");");
+                for (size_t i = 0; i < node->fields.size(); i++) out.line("mhs_field(v, " + std::to_string(i) + ") = std::move(f" + std::to_string(i) + ");");
+                out.line("return v;");
+                out.close();
+                return;
+            }
+            case NodeKind::Function: case NodeKind::Method: {
+                currentFunction = node;
+                markMoves(node);
+                scopes.push();
+                if (node->kind == NodeKind::Function && node->name == "main") {
+                    out.open("Value mhs_main() {");
+                    profileScope(node);
+                    emit(node->right);
+                    out.line("return Value(0);");
+                    out.close();
+                    scopes.pop();
+                    return;
+                }
+                std::string args = "";
+                if (node->kind == NodeKind::Method) {
+                    args += "const Value& var_this";
+                    scopes.declare("this", { true });
+                    if (!node->fn.params.empty()) args += ", ";
+                }
+                for (size_t i = 0; i < node->fn.params.size(); i++) {
+                    args += paramType(node, i) + " var_" + node->fn.params[i];
+                    scopes.declare(node->fn.params[i], { true });
+                    if (i < node->fn.params.size() - 1) args += ", ";
+                }
+                out.line("");
+                out.open(hints(node) + ctype(ty(node)) + " " + cppName(node) + "(" + args + ") {");
+                profileScope(node);
+                emit(node->right);
+                if (!endsWithReturn(node->right)) out.line("return Value();");
+                out.close();
+                scopes.pop();
+                return;
+            }
+            default: out.line(expr(node) + ";"); return;
         }
-        return "";
     }
+    // Everything function bodies refer to across the program: struct and method ids,
+    // signatures, interned symbols and profiler ids. Nothing here emits code.
+    void prepare(ASTNode* program) {
+        ParallelChecker checker;
+        checker.run(program);
+        own.slotWrites = std::move(checker.slotWrites);
+        own.sharedIters = std::move(checker.sharedIters);
+        collectSymbols(program);
+        own.parallel = contains(program, NodeKind::ParallelFor);
+        for (auto f : program->items) {
+            auto it = own.callCounts.find(cppName(f));
+            if (f->kind != NodeKind::Struct && it != own.callCounts.end()) own.totalCalls += it->second;
+        }
+        for (auto f : program->items) {
+            if (f->kind == NodeKind::Struct && !own.structIds.count(f->name)) {
+                own.structIds[f->name] = (int)own.structDefs.size();
+                own.structDefs.push_back(f);
+            }
+            if (f->kind == NodeKind::Method && !own.methodIds.count({f->name, f->fn.params.size()})) {
+                int id = (int)own.methodIds.size();
+                own.methodIds[{f->name, f->fn.params.size()}] = id;
+            }
+            if (f->kind == NodeKind::Function && f->name != "main") {
+                own.functionDefs[f->name] = f;
+                own.signatures.push_back(f);
+            }
+            if (f->kind == NodeKind::Method && !own.methodDefs.count(f->fn.structName + "." + f->name)) {
+                own.methodDefs[f->fn.structName + "." + f->name] = f;
+                own.signatures.push_back(f);
+            }
+            if (f->kind != NodeKind::Struct) {
+                auto& names = own.rebound[f];   // only paramType() asks, and only for non-int parameters
+                for (auto t : f->fn.paramTypes) if (t != T_INT) { collectAssigned(f->right, names); break; }
+            }
+            if (own.profile && f->kind != NodeKind::Struct) {
+                own.profileIds[f] = (int)own.profileNames.size();
+                own.profileNames.push_back(f->kind == NodeKind::Method ? f->fn.structName + "." + f->name : std::string(f->name));
+            }
+        }
+    }
+    // Pooled literals, symbols, structs and forward declarations; the shared header under --split.
+    void declarations(const std::vector<Name>& literals) {
+        for (size_t i = 0; i < literals.size(); i++) {
+            std::string id = std::to_string(i);
+            out.line(storage() + "const std::string mhs_str_" + id + " = \"" + escape_cpp(literals[i]) + "\";");
+            out.line(storage() + "const Value mhs_lit_" + id + " = Value(mhs_str_" + id + ");");
+        }
+        for (auto& [key, id] : g.symbols) out.line(storage() + "const MhsSym mhs_sym_" + std::to_string(id) + " = mhs_intern(\"" + key + "\");");
+        for (auto f : g.structDefs) emit(f);
+        for (auto f : g.signatures) out.line(forwardDecl(f));
+    }
+    void definition(ASTNode* f) {
+        if (f->kind == NodeKind::Struct) return;
+        emit(f);
+        out.line("");
+    }
+    void tables() {
+        if (!g.methodIds.empty()) for (auto st : g.structDefs) vtable(st);
+        if (g.profile) {
+            std::string names = "static const char* const mhs_profile_names[] = {";
+            for (size_t i = 0; i < g.profileNames.size(); i++) names += (i ? ", \"" : "\"") + g.profileNames[i] + "\"";
+            out.line(names + "};");
+            out.line("static const bool mhs_profiling = (mhs_profile_start(mhs_profile_names, " + std::to_string(g.profileNames.size()) + "), true);");
+        }
+    }
+    // Program-wide constants are static in a single output.cpp and inline variables in a shared header.
+    std::string storage() const { return g.split ? "inline " : "static "; }
+    ASTNode* currentFunction = nullptr;
+    int tempCounter = 0;
+    std::vector<int> breakScopes;      // enclosing loop ids, -1 for a C++ switch
+    std::map<std::pair<std::string, std::string>, std::pair<std::string, ASTNode*>> reductions;   // (helper, var) -> (accumulator, var node)
+    // A name used outside the block or loop that declared it would only fail later, in g++.
+    void declared(Name name) const {
+        if (scopes.has(name)) return;
+        std::cout << "[MHS ERROR] Unknown variable '" << name << "'" << std::endl;
+        exit(1);
+    }
+    void collectReductions(ASTNode* n, std::vector<ASTNode*>& out) {
+        if (n->kind == NodeKind::ParallelFor) return;
+        if (n->kind == NodeKind::Call && isReduction(n->name)) out.push_back(n);
+        forEachChild(n, [&](ASTNode* c) { collectReductions(c, out); });
+    }
+    std::set<int> usedBreakLabels;
+    void profileScope(ASTNode* f) {
+        if (!g.profile) return;
+        out.line("MhsProfileScope mhs_prof(" + std::to_string(g.profileIds.at(f)) + ");");
+    }
+    std::set<std::string_view> movedLocals;                    // locals of the current function that are moved from
+    size_t unitLines = 0;
 };
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cout << "Usage: mhs_compiler <file.mhs>\n";
-        return 1;
+// --interpret: the optimized AST is lowered to register bytecode and run in this
+// process on the runtime that generated programs link, so no C++ build is needed.
+// Each call gets a window of registers on one Value stack: parameters first (after
+// 'this' for methods), then locals and temporaries. A call's arguments are the
+// caller's topmost registers and become the callee's parameters in place.
+#define MHS_VM_OPS(X) \
+    X(LOADK) X(LOADNULL) X(MOVE) X(ADD) X(SUB) X(MUL) X(DIV) X(LT) X(GT) X(EQ) X(NE) X(TRUTH) \
+    X(JMP) X(JMPIF) X(JMPIFNOT) X(JNLT) X(JNGT) X(JNEQ) X(JNNE) \
+    X(FORPREP) X(FORLOOP) X(ITERPREP) X(ITERNEXT) X(CALL) X(CALLM) X(RET) \
+    X(NEW) X(ARRAY) X(MAP) X(GETFIELD) X(INDEX) X(INDEXK) X(SETINDEX) X(SETINDEXK) X(APPEND) \
+    X(PRINT) X(FLUSH) X(READFILE) X(WRITEFILE) X(LINES) X(NEXTLINE) X(LEN) X(PUSH) X(STRLEN) X(STRAT) \
+    X(RANDOM) X(INPUT) X(TOINT) X(JOIN) X(SUMINTO) X(MININTO) X(MAXINTO)
+enum VmOp : unsigned char {
+#define MHS_VM_ENUM(op) OP_##op,
+    MHS_VM_OPS(MHS_VM_ENUM)
+#undef MHS_VM_ENUM
+};
+// a is the destination register, or the target of a jump; b and c are registers,
+// constants or table indices depending on the opcode. Operands of arithmetic and
+// comparisons may also be ~k, naming constant k directly.
+struct VmInstr { unsigned op : 8, a : 24; int b, c; };
+struct VmFunction {
+    std::vector<VmInstr> code;
+    std::vector<Value> consts;
+    int nregs = 0;
+};
+// Inline cache of one field access site: the struct layout seen last and its slot.
+struct VmFieldSite { std::string name; MhsSym sym; const StructInfo* info = nullptr; int slot = -1; };
+struct VmProgram {
+    std::vector<VmFunction> functions;
+    std::vector<StructInfo> structs;                 // typeId = index
+    std::vector<std::vector<const char*>> fieldNames;
+    std::vector<std::vector<int>> methods;           // [typeId][method slot] -> function, -1 if none
+    std::vector<std::vector<MhsSym>> mapKeys;        // per map literal
+    std::vector<VmFieldSite> fields;
+    std::deque<std::string> names;                   // backs the const char* in structs
+    int mainFunction = -1;
+    const char* keep(std::string_view s) { return names.emplace_back(s).c_str(); }
+};
+
+class BytecodeGen {
+    VmProgram& prog;
+    VmFunction* fn = nullptr;
+    Scopes scopes;
+    int next = 0;                                    // first free register
+    struct Loop { std::vector<size_t> breaks, continues; };
+    std::vector<Loop> loops;
+    int parallelDepth = 0;
+    std::map<std::string_view, int> functionIds, structIds;
+    std::map<std::pair<std::string_view, size_t>, int> methodSlots;   // (name, arity) -> slot
+    std::vector<size_t> paramCount;                                   // per function
+    std::map<std::string_view, int> stringConsts;
+    std::map<long long, int> intConsts;
+    [[noreturn]] static void error(const std::string& msg) {
+        std::cout << "[MHS ERROR] " << msg << std::endl;
+        exit(1);
+    }
+    int temp() {
+        fn->nregs = std::max(fn->nregs, next + 1);
+        return next++;
+    }
+    int target(int dst) { return dst >= 0 ? dst : temp(); }
+    size_t emit(VmOp op, int a, int b = 0, int c = 0) {
+        fn->code.push_back({op, (unsigned)a, b, c});
+        return fn->code.size() - 1;
+    }
+    size_t here() const { return fn->code.size(); }
+    void patch(size_t at, size_t to) { fn->code[at].a = (unsigned)to; }
+    void patchAll(const std::vector<size_t>& jumps, size_t to) { for (auto j : jumps) patch(j, to); }
+    int constant(long long v) {
+        auto [it, fresh] = intConsts.try_emplace(v, (int)fn->consts.size());
+        if (fresh) fn->consts.push_back(Value(v));
+        return it->second;
+    }
+    int constant(std::string_view s) {
+        auto [it, fresh] = stringConsts.try_emplace(s, (int)fn->consts.size());
+        if (fresh) fn->consts.push_back(Value(s));
+        return it->second;
+    }
+    int local(Name name) {
+        const VarInfo* v = scopes.find(name);
+        if (!v) error("Unknown variable '" + name + "'");
+        return v->reg;
+    }
+    void declare(Name name, int reg) { scopes.declare(name, { true, nullptr, reg }); }
+    // Arguments go to consecutive registers at the top of the frame.
+    int arguments(Span<ASTNode*> args) {
+        int base = next;
+        for (size_t i = 0; i < args.size(); i++) temp();
+        for (size_t i = 0; i < args.size(); i++) expr(args[i], base + (int)i);
+        return base;
+    }
+    void arity(ASTNode* n, size_t want) {
+        if (n->items.size() != want) error(std::string(n->name) + " expects " + std::to_string(want) + " argument(s) but got " + std::to_string(n->items.size()));
+    }
+    int builtin(VmOp op, ASTNode* n, int dst, size_t argc) {
+        arity(n, argc);
+        int b = argc > 0 ? expr(n->items[0]) : 0, c = argc > 1 ? expr(n->items[1]) : 0;
+        int r = target(dst);
+        emit(op, r, b, c);
+        return r;
+    }
+    int call(ASTNode* n, int dst) {
+        Name c = n->name;
+        if (c == "print" || c == "push" || c == "flush" || isReduction(c)) {
+            // Statements in generated code; as values they are null.
+            if (c == "print") { arity(n, 1); emit(OP_PRINT, expr(n->items[0])); }
+            else if (c == "flush") { arity(n, 0); emit(OP_FLUSH, 0); }
+            else if (c == "push") { arity(n, 2); int a = expr(n->items[0]); emit(OP_PUSH, a, expr(n->items[1])); }
+            else {
+                if (!parallelDepth || n->items.size() != 2 || n->items[0]->kind != NodeKind::Variable)
+                    error(std::string(c) + "(var, value) is only allowed inside 'parallel for'");
+                emit(c == "sum_into" ? OP_SUMINTO : c == "min_into" ? OP_MININTO : OP_MAXINTO, local(n->items[0]->name), expr(n->items[1]));
+            }
+            int r = target(dst);
+            emit(OP_LOADNULL, r);
+            return r;
+        }
+        if (c == "len") return builtin(OP_LEN, n, dst, 1);
+        if (c == "at") return builtin(OP_INDEX, n, dst, 2);
+        if (c == "str_len") return builtin(OP_STRLEN, n, dst, 1);
+        if (c == "str_at") return builtin(OP_STRAT, n, dst, 2);
+        if (c == "read_file") return builtin(OP_READFILE, n, dst, 1);
+        if (c == "write_file") return builtin(OP_WRITEFILE, n, dst, 2);
+        if (c == "lines") return builtin(OP_LINES, n, dst, 1);
+        if (c == "next_line") return builtin(OP_NEXTLINE, n, dst, 1);
+        if (c == "random_int") return builtin(OP_RANDOM, n, dst, 1);
+        if (c == "to_int") return builtin(OP_TOINT, n, dst, 1);
+        if (c == "input" || c == "join") {
+            // The second operand is optional: -1 means no prompt, or an empty separator.
+            size_t first = c == "join";
+            if (n->items.size() < first || n->items.size() > first + 1) arity(n, first + 1);
+            int a = first ? expr(n->items[0]) : 0, b = n->items.size() > first ? expr(n->items[first]) : -1;
+            int r = target(dst);
+            emit(c == "join" ? OP_JOIN : OP_INPUT, r, first ? a : b, first ? b : 0);
+            return r;
+        }
+        auto st = structIds.find(c);
+        if (st != structIds.end()) {
+            const StructInfo& info = prog.structs[st->second];
+            if ((int)n->items.size() > info.nfields)
+                error("Struct '" + c + "' has " + std::to_string(info.nfields) + " fields but got " + std::to_string(n->items.size()) + " values");
+            int base = arguments(n->items);
+            for (int i = (int)n->items.size(); i < info.nfields; i++) emit(OP_LOADNULL, temp());
+            int r = target(dst);
+            emit(OP_NEW, r, st->second, base);
+            return r;
+        }
+        auto f = functionIds.find(c);
+        if (f == functionIds.end()) error("Unknown function '" + c + "'");
+        arity(n, paramCount[f->second]);
+        int base = arguments(n->items);
+        int r = target(dst);
+        emit(OP_CALL, r, f->second, base);
+        return r;
+    }
+    // Operand of an arithmetic op or comparison: a literal is read from the constant
+    // table in place (encoded as ~index) instead of being loaded on every pass.
+    int operand(ASTNode* n) {
+        if (n->kind == NodeKind::Number) return ~constant(n->numberValue);
+        if (n->kind == NodeKind::String) return ~constant(std::string_view(n->name));
+        return expr(n);
     }
-    std::ifstream f(argv[1]);
+    int logical(ASTNode* n, int dst) {
+        // r := truthy(left); skip the right side once the result is known.
+        int r = temp();
+        emit(OP_TRUTH, r, expr(n->left));
+        size_t skip = emit(n->name == "&&" ? OP_JMPIFNOT : OP_JMPIF, 0, r);
+        emit(OP_TRUTH, r, expr(n->right));
+        patch(skip, here());
+        if (dst >= 0 && dst != r) emit(OP_MOVE, dst, r);
+        return dst >= 0 ? dst : r;
+    }
+    int expr(ASTNode* n, int dst = -1) {
+        switch (n->kind) {
+            case NodeKind::Null: { int r = target(dst); emit(OP_LOADNULL, r); return r; }
+            case NodeKind::Number: { int r = target(dst); emit(OP_LOADK, r, constant(n->numberValue)); return r; }
+            case NodeKind::String: { int r = target(dst); emit(OP_LOADK, r, constant(std::string_view(n->name))); return r; }
+            case NodeKind::Variable: {
+                int v = local(n->name);
+                if (dst < 0 || dst == v) return v;
+                emit(OP_MOVE, dst, v);
+                return dst;
+            }
+            case NodeKind::BinaryOp: {
+                Name op = n->name;
+                if (op == "&&" || op == "||") return logical(n, dst);
+                int l = operand(n->left), r = operand(n->right), d = target(dst);
+                VmOp code = op == "+" ? OP_ADD : op == "-" ? OP_SUB : op == "*" ? OP_MUL : op == "/" ? OP_DIV :
+                            op == "<" ? OP_LT : op == ">" ? OP_GT : op == "==" ? OP_EQ : OP_NE;
+                emit(code, d, l, r);
+                return d;
+            }
+            case NodeKind::Array: {
+                int base = arguments(n->items);
+                int r = target(dst);
+                emit(OP_ARRAY, r, base, (int)n->items.size());
+                return r;
+            }
+            case NodeKind::Map: {
+                int base = arguments(n->map.values);
+                std::vector<MhsSym> keys;
+                for (auto k : n->map.keys) keys.push_back(mhs_intern(k));
+                prog.mapKeys.push_back(std::move(keys));
+                int r = target(dst);
+                emit(OP_MAP, r, base, (int)prog.mapKeys.size() - 1);
+                return r;
+            }
+            case NodeKind::IndexAccess: {
+                int obj = expr(n->left);
+                if (n->right->kind == NodeKind::String) {
+                    int r = target(dst);
+                    emit(OP_INDEXK, r, obj, (int)mhs_intern(n->right->name));
+                    return r;
+                }
+                int idx = expr(n->right), r = target(dst);
+                emit(OP_INDEX, r, obj, idx);
+                return r;
+            }
+            case NodeKind::MemberAccess: {
+                int obj = expr(n->left), r = target(dst);
+                prog.fields.push_back({ std::string(n->name), mhs_intern(n->name) });
+                emit(OP_GETFIELD, r, obj, (int)prog.fields.size() - 1);
+                return r;
+            }
+            case NodeKind::MethodCall: {
+                int base = next;
+                expr(n->left, temp());
+                for (size_t i = 0; i < n->items.size(); i++) temp();
+                for (size_t i = 0; i < n->items.size(); i++) expr(n->items[i], base + 1 + (int)i);
+                auto slot = methodSlots.find({ n->name, n->items.size() });
+                int r = target(dst);
+                emit(OP_CALLM, r, slot == methodSlots.end() ? -1 : slot->second, base);
+                return r;
+            }
+            case NodeKind::Call: return call(n, dst);
+            default: error("Unsupported expression");
+        }
+    }
+    // Jumps to be patched to the false branch of a condition; comparisons fuse with the jump.
+    std::vector<size_t> jumpUnless(ASTNode* n) {
+        if (n->kind == NodeKind::BinaryOp) {
+            Name op = n->name;
+            if (op == "&&") {
+                auto j = jumpUnless(n->left), k = jumpUnless(n->right);
+                j.insert(j.end(), k.begin(), k.end());
+                return j;
+            }
+            if (op == "<" || op == ">" || op == "==" || op == "!=") {
+                int l = operand(n->left), r = operand(n->right);
+                return { emit(op == "<" ? OP_JNLT : op == ">" ? OP_JNGT : op == "==" ? OP_JNEQ : OP_JNNE, 0, l, r) };
+            }
+        }
+        return { emit(OP_JMPIFNOT, 0, expr(n)) };
+    }
+    void block(ASTNode* b) {
+        scopes.push();
+        int mark = next;
+        for (auto s : b->items) stmt(s);
+        next = mark;
+        scopes.pop();
+    }
+    void stmt(ASTNode* s) {
+        int mark = next;
+        switch (s->kind) {
+            case NodeKind::Declaration: {
+                int v = temp();
+                expr(s->left, v);
+                declare(s->name, v);
+                next = v + 1;
+                return;
+            }
+            case NodeKind::Assignment: {
+                int v = local(s->name);
+                // Same in-place append as generated code: 's := s + a + b' when no piece reads s.
+                std::vector<ASTNode*> pieces;
+                ASTNode* l = s->left;
+                for (; l->kind == NodeKind::BinaryOp && l->name == "+"; l = l->left) pieces.push_back(l->right);
+                bool chain = !pieces.empty() && l->kind == NodeKind::Variable && l->name == s->name;
+                for (auto p : pieces) chain = chain && !mentions(p, s->name);
+                if (chain) for (auto it = pieces.rbegin(); it != pieces.rend(); ++it) emit(OP_APPEND, v, expr(*it));
+                else expr(s->left, v);
+                break;
+            }
+            case NodeKind::IndexAssignment: {
+                int v = local(s->name);
+                if (s->left->kind == NodeKind::String) emit(OP_SETINDEXK, v, (int)mhs_intern(s->left->name), expr(s->right));
+                else {
+                    int idx = expr(s->left);
+                    emit(OP_SETINDEX, v, idx, expr(s->right));
+                }
+                break;
+            }
+            case NodeKind::Return: emit(OP_RET, expr(s->left)); break;
+            case NodeKind::If: {
+                auto skip = jumpUnless(s->left);
+                block(s->right);
+                if (s->elseBranch) {
+                    size_t end = emit(OP_JMP, 0);
+                    patchAll(skip, here());
+                    block(s->elseBranch);
+                    patch(end, here());
+                } else patchAll(skip, here());
+                break;
+            }
+            case NodeKind::While: {
+                size_t top = here();
+                auto exit = jumpUnless(s->left);
+                next = mark;
+                loops.push_back({});
+                block(s->right);
+                emit(OP_JMP, (int)top);
+                patchAll(exit, here());
+                endLoop(top, here());
+                break;
+            }
+            case NodeKind::For: case NodeKind::ParallelFor: {
+                // counter and end sit in adjacent registers; the loop variable is a fresh copy each pass.
+                // 'parallel for' runs its chunks in order here, which is one valid schedule.
+                int counter = temp();
+                temp();
+                expr(s->left, counter);
+                expr(s->right, counter + 1);
+                next = counter + 2;
+                size_t prep = emit(OP_FORPREP, 0, counter);
+                size_t top = here();
+                scopes.push();
+                int v = temp();
+                declare(s->name, v);
+                emit(OP_MOVE, v, counter);
+                loops.push_back({});
+                parallelDepth += s->kind == NodeKind::ParallelFor;
+                block(s->elseBranch);
+                parallelDepth -= s->kind == NodeKind::ParallelFor;
+                scopes.pop();
+                size_t step = emit(OP_FORLOOP, (int)top, counter);
+                patch(prep, here());
+                endLoop(step, here());
+                break;
+            }
+            case NodeKind::ForEach: {
+                int src = temp();
+                temp();
+                expr(s->left, src);
+                next = src + 2;
+                emit(OP_ITERPREP, src);
+                scopes.push();
+                int v = temp();
+                declare(s->name, v);
+                size_t top = emit(OP_ITERNEXT, 0, src, v);
+                loops.push_back({});
+                block(s->right);
+                scopes.pop();
+                emit(OP_JMP, (int)top);
+                patch(top, here());
+                endLoop(top, here());
+                break;
+            }
+            case NodeKind::Switch: {
+                // First equal case wins, as in the generated switch; break leaves the enclosing loop.
+                int scrutinee = expr(s->left);
+                std::vector<size_t> hits, ends;
+                for (auto c : s->sw.cases) {
+                    int k = expr(c);
+                    hits.push_back(emit(OP_JNNE, 0, scrutinee, k));
+                }
+                ends.push_back(emit(OP_JMP, 0));
+                for (size_t i = 0; i < s->sw.blocks.size(); i++) {
+                    patch(hits[i], here());
+                    block(s->sw.blocks[i]);
+                    ends.push_back(emit(OP_JMP, 0));
+                }
+                patchAll(ends, here());
+                break;
+            }
+            case NodeKind::Break: case NodeKind::Continue: {
+                if (loops.empty()) error(std::string(s->kind == NodeKind::Break ? "'break'" : "'continue'") + " outside a loop");
+                (s->kind == NodeKind::Break ? loops.back().breaks : loops.back().continues).push_back(emit(OP_JMP, 0));
+                break;
+            }
+            case NodeKind::Block: block(s); break;
+            default: expr(s); break;
+        }
+        next = mark;
+    }
+    void endLoop(size_t continueAt, size_t exitAt) {
+        patchAll(loops.back().continues, continueAt);
+        patchAll(loops.back().breaks, exitAt);
+        loops.pop_back();
+    }
+    void function(ASTNode* f, int id) {
+        fn = &prog.functions[id];
+        stringConsts.clear();
+        intConsts.clear();
+        next = 0;
+        scopes.push();
+        if (f->kind == NodeKind::Method) declare(Name("this"), temp());
+        for (auto p : f->fn.params) declare(p, temp());
+        block(f->right);
+        int r = temp();
+        emit(OP_LOADNULL, r);
+        emit(OP_RET, r);
+        scopes.pop();
+    }
+public:
+    explicit BytecodeGen(VmProgram& prog) : prog(prog) {}
+    void run(ASTNode* program) {
+        for (auto f : program->items) {
+            if (f->kind != NodeKind::Struct || structIds.count(f->name)) continue;
+            int id = (int)prog.structs.size();
+            structIds[f->name] = id;
+            prog.fieldNames.emplace_back();
+            for (auto fl : f->fields) prog.fieldNames.back().push_back(prog.keep(fl));
+            prog.structs.push_back({ prog.keep(f->name), id, (int)f->fields.size(), nullptr, nullptr });
+        }
+        for (size_t i = 0; i < prog.structs.size(); i++) prog.structs[i].fields = prog.fieldNames[i].data();
+        prog.methods.assign(prog.structs.size(), {});
+        std::vector<std::pair<ASTNode*, int>> bodies;
+        std::set<std::string> methodKeys;            // "Struct.method": the first definition wins
+        for (auto f : program->items) {
+            if (f->kind != NodeKind::Function && f->kind != NodeKind::Method) continue;
+            int id = (int)prog.functions.size();
+            prog.functions.emplace_back();
+            paramCount.push_back(f->fn.params.size());
+            bodies.push_back({ f, id });
+            if (f->kind == NodeKind::Function) {
+                functionIds[f->name] = id;           // a later definition replaces an earlier one
+                if (f->name == "main") prog.mainFunction = id;
+                continue;
+            }
+            auto st = structIds.find(f->fn.structName);
+            if (st == structIds.end() || !methodKeys.insert(f->fn.structName + "." + f->name).second) continue;
+            int slot = methodSlots.try_emplace({ f->name, f->fn.params.size() }, (int)methodSlots.size()).first->second;
+            auto& table = prog.methods[st->second];
+            if ((int)table.size() <= slot) table.resize(slot + 1, -1);
+            table[slot] = id;
+        }
+        if (prog.mainFunction < 0) error("No main function");
+        ParallelChecker().run(program);
+        for (auto& [f, id] : bodies) function(f, id);
+    }
+};
+
+class Vm {
+    VmProgram& prog;
+    bool lineBuffered;
+    std::vector<Value> stack;
+    // Plain copy when neither side owns a heap object, skipping refcounting.
+    static void copy(Value& d, const Value& s) {
+        if (d.slen != Value::HEAP && s.slen != Value::HEAP) std::memcpy((void*)&d, (const void*)&s, sizeof(Value));
+        else d = s;
+    }
+    static void setInt(Value& v, long long x) {
+        if (v.slen == Value::HEAP) v = Value(x);
+        else { v.type = 1; v.slen = 0; v.iVal = x; }
+    }
+    static bool ints(const Value& a, const Value& b) { return a.type == 1 && b.type == 1; }
+    // A caller waiting for RET: its function, register window and CALL instruction.
+    struct Frame { const VmFunction* fn; size_t base; const VmInstr* pc; };
+    std::vector<Frame> frames;
+public:
+    Vm(VmProgram& prog, bool lineBuffered) : prog(prog), lineBuffered(lineBuffered) {}
+    // Runs function f with its registers starting at stack[base]; they are cleared on return.
+    // MHS calls stay in this loop: CALL pushes a Frame and RET pops it, so recursion is
+    // bounded by memory, as in compiled code, rather than by the native stack.
+    Value call(int f, size_t base) {
+        static void* const labels[] = {
+#define MHS_VM_LABEL(op) &&L_##op,
+            MHS_VM_OPS(MHS_VM_LABEL)
+#undef MHS_VM_LABEL
+        };
+        const size_t depth = frames.size();
+        const VmFunction* fn;
+        Value* R;
+        const Value* K;
+        const VmInstr* code;
+        const VmInstr* pc;
+#define ENTER(g, b) do { \
+            fn = &prog.functions[g]; \
+            base = (b); \
+            if (stack.size() < base + fn->nregs) stack.resize(std::max(base + fn->nregs, stack.size() * 2)); \
+            R = stack.data() + base; K = fn->consts.data(); code = fn->code.data(); pc = code; \
+        } while (0)
+        ENTER(f, base);
+#define DISPATCH() goto *labels[pc->op]
+#define NEXT() do { pc++; DISPATCH(); } while (0)
+#define JUMP(to) do { pc = code + (to); DISPATCH(); } while (0)
+#define RK(x) ((x) >= 0 ? R[x] : K[~(x)])
+        DISPATCH();
+    L_LOADK: copy(R[pc->a], K[pc->b]); NEXT();
+    L_LOADNULL: R[pc->a] = Value(); NEXT();
+    L_MOVE: copy(R[pc->a], R[pc->b]); NEXT();
+    L_ADD: {
+        const Value &x = RK(pc->b), &y = RK(pc->c);
+        if (ints(x, y)) setInt(R[pc->a], mhs_add(x.iVal, y.iVal));
+        else R[pc->a] = x + y;
+        NEXT();
+    }
+    L_SUB: {
+        const Value &x = RK(pc->b), &y = RK(pc->c);
+        if (ints(x, y)) setInt(R[pc->a], mhs_sub(x.iVal, y.iVal));
+        else R[pc->a] = x - y;
+        NEXT();
+    }
+    L_MUL: {
+        const Value &x = RK(pc->b), &y = RK(pc->c);
+        if (ints(x, y)) setInt(R[pc->a], mhs_mul(x.iVal, y.iVal));
+        else R[pc->a] = x * y;
+        NEXT();
+    }
+    L_DIV: R[pc->a] = RK(pc->b) / RK(pc->c); NEXT();
+    L_LT: {
+        const Value &x = RK(pc->b), &y = RK(pc->c);
+        if (ints(x, y)) setInt(R[pc->a], x.iVal < y.iVal);
+        else R[pc->a] = x < y;
+        NEXT();
+    }
+    L_GT: {
+        const Value &x = RK(pc->b), &y = RK(pc->c);
+        if (ints(x, y)) setInt(R[pc->a], x.iVal > y.iVal);
+        else R[pc->a] = x > y;
+        NEXT();
+    }
+    L_EQ: R[pc->a] = RK(pc->b) == RK(pc->c); NEXT();
+    L_NE: R[pc->a] = RK(pc->b) != RK(pc->c); NEXT();
+    L_TRUTH: setInt(R[pc->a], R[pc->b].is_true()); NEXT();
+    L_JMP: JUMP(pc->a);
+    L_JMPIF: if (R[pc->b].is_true()) JUMP(pc->a); NEXT();
+    L_JMPIFNOT: if (!R[pc->b].is_true()) JUMP(pc->a); NEXT();
+    L_JNLT: {
+        const Value &x = RK(pc->b), &y = RK(pc->c);
+        if (ints(x, y) ? !(x.iVal < y.iVal) : !(x < y).iVal) JUMP(pc->a);
+        NEXT();
+    }
+    L_JNGT: {
+        const Value &x = RK(pc->b), &y = RK(pc->c);
+        if (ints(x, y) ? !(x.iVal > y.iVal) : !(x > y).iVal) JUMP(pc->a);
+        NEXT();
+    }
+    L_JNEQ: {
+        const Value &x = RK(pc->b), &y = RK(pc->c);
+        if (ints(x, y) ? x.iVal != y.iVal : !(x == y).iVal) JUMP(pc->a);
+        NEXT();
+    }
+    L_JNNE: {
+        const Value &x = RK(pc->b), &y = RK(pc->c);
+        if (ints(x, y) ? x.iVal == y.iVal : !(x != y).iVal) JUMP(pc->a);
+        NEXT();
+    }
+    L_FORPREP: {
+        Value* c = R + pc->b;
+        long long from = c[0].as_int(), to = c[1].as_int();
+        setInt(c[0], from);
+        setInt(c[1], to);
+        if (from > to) JUMP(pc->a);
+        NEXT();
+    }
+    L_FORLOOP: {
+        // The end is inclusive: stop on reaching it rather than stepping past it.
+        Value* c = R + pc->b;
+        if (c[0].iVal != c[1].iVal) { ++c[0].iVal; JUMP(pc->a); }
+        NEXT();
+    }
+    L_ITERPREP:
+        if (R[pc->a].type != 4 && R[pc->a].type != 6) mhs_panic("Type error: value is not iterable");
+        setInt(R[pc->a + 1], 0);
+        NEXT();
+    L_ITERNEXT: {
+        // b is the iterable, b + 1 the position in an array; c receives the element.
+        const Value& src = R[pc->b];
+        if (src.type == 6) {
+            LinesObj* l = static_cast<LinesObj*>(src.obj);
+            if (!l->next()) JUMP(pc->a);
+            R[pc->c] = Value(l->line());
+            NEXT();
+        }
+        long long& i = R[pc->b + 1].iVal;
+        if ((size_t)i >= src.arr().size()) JUMP(pc->a);
+        R[pc->c] = src.arr()[i++];
+        NEXT();
+    }
+    L_CALL: {
+        int g = pc->b;
+        size_t args = base + pc->c;
+        frames.push_back({fn, base, pc});
+        ENTER(g, args);
+        DISPATCH();
+    }
+    L_CALLM: {
+        const Value& self = R[pc->c];
+        int m = -1;
+        if (self.type == 3 && pc->b >= 0) {
+            auto& table = prog.methods[static_cast<StructObj*>(self.obj)->info->typeId];
+            if ((size_t)pc->b < table.size()) m = table[pc->b];
+        }
+        if (m < 0) mhs_panic("Method not found");
+        size_t args = base + pc->c;
+        frames.push_back({fn, base, pc});
+        ENTER(m, args);
+        DISPATCH();
+    }
+    L_RET: {
+        Value result = std::move(R[pc->a]);
+        for (int i = 0; i < fn->nregs; i++) R[i] = Value();
+        if (frames.size() == depth) return result;
+        Frame caller = frames.back();
+        frames.pop_back();
+        fn = caller.fn;
+        base = caller.base;
+        R = stack.data() + base; K = fn->consts.data(); code = fn->code.data(); pc = caller.pc;
+        R[pc->a] = std::move(result);
+        NEXT();
+    }
+    L_NEW: {
+        const StructInfo* info = &prog.structs[pc->b];
+        Value v = Value::new_struct(info);
+        for (int i = 0; i < info->nfields; i++) mhs_field(v, i) = std::move(R[pc->c + i]);
+        R[pc->a] = std::move(v);
+        NEXT();
+    }
+    L_ARRAY: {
+        std::vector<Value> elems;
+        elems.reserve(pc->c);
+        for (int i = 0; i < pc->c; i++) elems.push_back(std::move(R[pc->b + i]));
+        R[pc->a] = Value::make_array(std::move(elems));
+        NEXT();
+    }
+    L_MAP: {
+        MhsDict m;
+        const std::vector<MhsSym>& keys = prog.mapKeys[pc->c];
+        for (size_t i = 0; i < keys.size(); i++) {
+            size_t n = m.size();
+            Value& slot = m.get(keys[i]);
+            if (m.size() > n) slot = std::move(R[pc->b + i]);   // the first of duplicate keys wins
+        }
+        R[pc->a] = Value::make_map(std::move(m));
+        NEXT();
+    }
+    L_GETFIELD: {
+        VmFieldSite& site = prog.fields[pc->c];
+        const Value& obj = R[pc->b];
+        if (obj.type != 3) { R[pc->a] = obj.get_safe(site.name, site.sym); NEXT(); }
+        StructObj* so = static_cast<StructObj*>(obj.obj);
+        if (so->info != site.info) { site.info = so->info; site.slot = so->info->find(site.name); }
+        R[pc->a] = site.slot < 0 ? Value() : so->fields()[site.slot];
+        NEXT();
+    }
+    L_INDEX: R[pc->a] = R[pc->b].at(R[pc->c]); NEXT();
+    L_INDEXK: R[pc->a] = R[pc->b].at_sym((MhsSym)pc->c); NEXT();
+    L_SETINDEX: R[pc->a].set(R[pc->b], R[pc->c]); NEXT();
+    L_SETINDEXK: R[pc->a].set_sym((MhsSym)pc->b, R[pc->c]); NEXT();
+    L_APPEND: mhs_append(R[pc->a], R[pc->b]); NEXT();
+    L_PRINT:
+        std::cout << R[pc->a] << '\n';
+        if (lineBuffered) std::cout.flush();
+        NEXT();
+    L_FLUSH: mhs_flush(); NEXT();
+    L_READFILE: R[pc->a] = std_read_file(R[pc->b].str()); NEXT();
+    L_WRITEFILE: R[pc->a] = Value(std_write_file(R[pc->b].str_view(), R[pc->c])); NEXT();
+    L_LINES: R[pc->a] = std_lines(R[pc->b].str()); NEXT();
+    L_NEXTLINE: R[pc->a] = R[pc->b].next_line(); NEXT();
+    L_LEN: setInt(R[pc->a], R[pc->b].len()); NEXT();
+    L_PUSH: R[pc->a].array_push(R[pc->b]); NEXT();
+    L_STRLEN: setInt(R[pc->a], (long long)R[pc->b].str_view().length()); NEXT();
+    L_STRAT: R[pc->a] = Value(mhs_str_at(R[pc->b].str_view(), R[pc->c].as_int())); NEXT();
+    L_RANDOM: setInt(R[pc->a], std_random(0, R[pc->b].as_int() - 1)); NEXT();
+    L_INPUT: R[pc->a] = Value(pc->b < 0 ? std_input() : std_input(R[pc->b].str())); NEXT();
+    L_TOINT: setInt(R[pc->a], std_to_int(R[pc->b].str())); NEXT();
+    L_JOIN: R[pc->a] = Value(std_join(R[pc->b], pc->c < 0 ? std::string_view() : R[pc->c].str_view())); NEXT();
+    L_SUMINTO: setInt(R[pc->a], mhs_add(R[pc->a].as_int(), R[pc->b].as_int())); NEXT();
+    L_MININTO: setInt(R[pc->a], std::min(R[pc->a].as_int(), R[pc->b].as_int())); NEXT();
+    L_MAXINTO: setInt(R[pc->a], std::max(R[pc->a].as_int(), R[pc->b].as_int())); NEXT();
+#undef RK
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+#undef ENTER
+    }
+    void run() {
+        mhs_init_stdout();
+        call(prog.mainFunction, 0);
+        std::cout.flush();
+    }
+};
+
+static std::string readFile(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
     std::stringstream buffer;
     buffer << f.rdbuf();
-    Lexer l(buffer.str());
-    Parser p(l.tokenize());
-    Compiler c;
-    std::ofstream out("output.cpp");
-    out << "#include <iostream>\n#include <fstream>\n#include <sstream>\n#include <string>\n#include <vector>\n#include <map>\n#include <memory>\n#include <limits>\n#include <ctime>\n#include <cstdlib>\n";
-    out << "struct Value;\n";
-    out << "Value mhs_dispatch_method(Value, std::string, std::vector<Value>);\n";
-    out << "struct Value {\n";
-    out << " int type = 0; long long iVal = 0; std::string sVal;\n";
-    out << " std::shared_ptr<std::map<std::string, Value>> members;\n";
-    out << " std::shared_ptr<std::vector<Value>> arrayVals;\n";
-    out << " Value() : type(0) {}\n";
-    out << " Value(int i) : type(1), iVal(i) {}\n";
-    out << " Value(long long i) : type(1), iVal(i) {}\n";
-    out << " Value(std::string s) : type(2), sVal(s) {}\n";
-    out << " static Value make_array(std::vector<Value> elems) { Value v; v.type = 4; v.arrayVals = std::make_shared<std::vector<Value>>(elems); return v; }\n";
-    out << " static Value make_map(std::map<std::string, Value> elems) { Value v; v.type = 5; v.members = std::make_shared<std::map<std::string, Value>>(elems); return v; }\n";
-    out << " int len() const { if(type==4) return arrayVals->size(); if(type==5) return members->size(); return 0; }\n";
-    out << " void array_push(Value v) const { if(type==4) arrayVals->push_back(v); }\n";
-    out << " Value at(Value idx) const {\n";
-    out << " if(type==4) { int i = idx.iVal; if(i < 0 || i >= arrayVals->size()) { std::cerr << \"[PANIC] Index out of bounds\" << std::endl; exit(1); } return arrayVals->at(i); }\n";
-    out << " if(type==5) { std::string k = idx.sVal; if(members->find(k) == members->end()) return Value(); return members->at(k); }\n";
-    out << " return Value();\n";
-    out << " }\n";
-    out << " void set(Value idx, Value val) const { if(type==4) (*arrayVals)[idx.iVal] = val; if(type==5) (*members)[idx.sVal] = val; }\n";
-    out << " static Value make_struct(std::string name, std::vector<Value> args);\n";
-    out << " Value get_safe(std::string name) const { if (members && members->count(name)) return members->at(name); return Value(); }\n";
-    out << " bool is_true() const { return (type==1 && iVal!=0) || (type==2 && !sVal.empty()); }\n";
-    out << " friend std::ostream& operator<<(std::ostream& os, const Value& v) {\n";
-    out << " if(v.type==0) os << \"null\";\n";
-    out << " else if(v.type==1) os << v.iVal;\n";
-    out << " else if(v.type==2) os << v.sVal;\n";
-    out << " else if(v.type==4) { os << \"[\"; for(size_t i=0; i<v.arrayVals->size(); i++) { os << (*v.arrayVals)[i]; if(i<v.arrayVals->size()-1) os << \", \"; } os << \"]\"; }\n";
-    out << " else if(v.type==5) { os << \"{\"; int c=0; for(auto const& p : *v.members) { os << p.first << \": \" << p.second; if(c++ < v.members->size()-1) os << \", \"; } os << \"}\"; }\n";
-    out << " else os << \"[Object]\";\n";
-    out << " return os;\n";
-    out << " }\n";
-    out << " Value operator+(const Value& o) const { return Value(to_string() + o.to_string()); }\n";
-    out << " Value operator*(const Value& o) const { long long res = iVal * o.iVal; if (res > std::numeric_limits<int>::max() || res < std::numeric_limits<int>::min()) { std::cerr << \"[PANIC] Overflow\" << std::endl; exit(1); } return Value((int)res); }\n";
-    out << " Value operator-(const Value& o) const { return Value((int)(iVal - o.iVal)); }\n";
-    out << " Value operator>(const Value& o) const { return Value((int)(iVal > o.iVal)); }\n";
-    out << " Value operator<(const Value& o) const { return Value((int)(iVal < o.iVal)); }\n";
-    out << " Value operator==(const Value& o) const { if(type!=o.type) return Value(0); if(type==1) return Value((int)(iVal==o.iVal)); return Value((int)(sVal==o.sVal)); }\n";
-    out << " Value operator!=(const Value& o) const { return Value((int)!((*this == o).is_true())); }\n";  // ← FINAL WORKING FIX
-    out << " Value operator&&(const Value& o) const { return Value((int)(iVal && o.iVal)); }\n";
-    out << " std::string to_string() const { std::stringstream ss; ss << *this; return ss.str(); }\n";
-    out << "};\n";
-    out << "Value mhs_main();\n";
-    out << "int main() { mhs_main(); return 0; }\n";
-
-    // RUNTIME FUNCTIONS
-    out << "int std_random(int min, int max) { static bool init = false; if(!init){srand(time(0)); init=true;} return min + rand() % (max - min + 1); }\n";
-    out << "std::string std_input() { std::string s; std::getline(std::cin, s); return s; }\n";
-    out << "std::string std_input(std::string prompt) { std::cout << prompt; std::string s; std::getline(std::cin, s); return s; }\n";
-    out << "long long std_to_int(std::string s) { try { return std::stoll(s); } catch (...) { std::cerr << \"[PANIC] Invalid number: \\\"\" << s << \"\\\"\" << std::endl; exit(1); } }\n";
-
-    std::map<std::string, VarInfo> empty;
-    out << c.generate(p.parseProgram(), empty);
-    out.close();
+    return buffer.str();
+}
+
+// Wall-clock time per compiler phase and peak memory, reported on stderr by --time-phases.
+struct PhaseTimer {
+    bool enabled = false;
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+    void lap(const char* phase) {
+        auto now = std::chrono::steady_clock::now();
+        if (enabled) std::cerr << phase << ": " << std::chrono::duration<double, std::milli>(now - last).count() << " ms" << std::endl;
+        last = now;
+    }
+    void peakMemory() const {
+        struct rusage ru;
+        if (enabled && getrusage(RUSAGE_SELF, &ru) == 0) std::cerr << "peak RSS: " << ru.ru_maxrss / 1024 << " MB" << std::endl;
+    }
+};
+
+// Settings that change the generated code; 'run' puts all of them in its cache key.
+struct CompileOptions {
+    bool lineBuffered = false;
+    bool profile = false;
+    int optLevel = 1;
+    int units = 1;                                           // --split: translation units, generated in parallel
+    std::map<std::string, unsigned long long> callCounts;   // --pgo: from the training run, see Compiler::hints
+};
+
+// Lexing, parsing and (at -O1) AST optimization, shared by both back ends.
+static ASTNode* frontEnd(const std::string& source, AstArena& arena, Optimizer& optimizer, const CompileOptions& opts, PhaseTimer& timer) {
+    Lexer l(source);
+    std::vector<Token> tokens = l.tokenize();
+    timer.lap("lex");
+    Parser p(std::move(tokens), arena);
+    ASTNode* program = p.parseProgram();
+    timer.lap("parse");
+    if (opts.optLevel > 0) optimizer.run(program);
+    timer.lap("optimize");
+    return program;
+}
+
+// Front end plus code generation; parallel tells the caller which runtime to link.
+// Returns output.cpp, or under --split the shared output.h followed by the units.
+static std::vector<std::string> compileToCpp(const std::string& source, const CompileOptions& opts, bool& parallel, PhaseTimer timer = {}) {
+    AstArena arena;
+    Optimizer optimizer(arena);
+    ASTNode* program = frontEnd(source, arena, optimizer, opts, timer);
+    TypeInference types;
+    types.run(program);
+    timer.lap("infer");
+    Compiler c(opts.lineBuffered, opts.profile, opts.callCounts);
+    std::vector<std::string> code = opts.units > 1 ? c.generateUnits(program, optimizer.literals, opts.units)
+                                                   : std::vector<std::string>{ c.generate(program, optimizer.literals) };
+    timer.lap("generate");
+    if (timer.enabled) std::cerr << "output: " << c.outputLines() << " lines" << std::endl;
+    timer.peakMemory();
+    parallel = c.usesParallel();
+    // The runtime is a prebuilt library; see the Makefile for the matching build flags.
+    // Each unit includes it first, ahead of output.h, so its precompiled header applies.
+    std::string runtime = parallel ? "#include \"mhs_runtime_mt.h\"\n" : "#include \"mhs_runtime.h\"\n";
+    if (code.size() == 1) return { runtime + code[0] };
+    code[0] = "#pragma once\n" + runtime + code[0];
+    for (size_t k = 1; k < code.size(); k++) code[k] = runtime + "#include \"output.h\"\n" + code[k];
+    return code;
+}
+
+// Writes compileToCpp's output into dir and returns the C++ sources to build.
+static std::vector<std::filesystem::path> writeUnits(const std::filesystem::path& dir, const std::vector<std::string>& code) {
+    if (code.size() == 1) {
+        std::ofstream(dir / "output.cpp") << code[0];
+        return { dir / "output.cpp" };
+    }
+    std::ofstream(dir / "output.h") << code[0];
+    std::vector<std::filesystem::path> sources;
+    for (size_t k = 1; k < code.size(); k++) {
+        sources.push_back(dir / ("output_" + std::to_string(k - 1) + ".cpp"));
+        std::ofstream(sources.back()) << code[k];
+    }
+    return sources;
+}
+
+// Front end plus bytecode, run in this process.
+static int interpret(const std::string& source, const CompileOptions& opts, PhaseTimer timer) {
+    AstArena arena;
+    Optimizer optimizer(arena);
+    ASTNode* program = frontEnd(source, arena, optimizer, opts, timer);
+    TypeInference types;   // ParallelChecker needs the types code generation would see
+    types.run(program);
+    timer.lap("infer");
+    VmProgram bytecode;
+    BytecodeGen(bytecode).run(program);
+    timer.lap("lower");
+    Vm(bytecode, opts.lineBuffered).run();
+    timer.lap("run");
+    timer.peakMemory();
+    return 0;
+}
+
+// Must match CXXFLAGS in the Makefile, or the precompiled runtime header is ignored.
+static const std::vector<std::string> cxxFlags = { "-std=c++17", "-O2" };
+
+// $MHS_RUNTIME_DIR, else runtime/ next to the compiler binary.
+static std::filesystem::path runtimeDir() {
+    if (const char* d = getenv("MHS_RUNTIME_DIR")) return d;
+    return std::filesystem::read_symlink("/proc/self/exe").parent_path() / "runtime";
+}
+
+static std::filesystem::path cacheDir() {
+    if (const char* d = getenv("MHS_CACHE_DIR")) return d;
+    if (const char* d = getenv("XDG_CACHE_HOME")) return std::filesystem::path(d) / "mhs";
+    const char* home = getenv("HOME");
+    return std::filesystem::path(home ? home : "/tmp") / ".cache" / "mhs";
+}
+
+// $CXX split into words, else g++.
+static std::vector<std::string> cxxDriver() {
+    std::vector<std::string> cxx;
+    std::istringstream words(getenv("CXX") ? getenv("CXX") : "g++");
+    for (std::string w; words >> w;) cxx.push_back(w);
+    return cxx;
+}
+
+// Optionally redirects the child's stdin from, and stdout and stderr to, files.
+// Returns the child's pid, or -1 if it could not be started.
+static pid_t spawn(const std::vector<std::string>& args, const std::string& in = "", const std::string& out = "", const std::string& err = "") {
+    std::vector<char*> argv;
+    for (auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (!in.empty()) posix_spawn_file_actions_addopen(&actions, 0, in.c_str(), O_RDONLY, 0);
+    if (!out.empty()) posix_spawn_file_actions_addopen(&actions, 1, out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (!err.empty()) posix_spawn_file_actions_addopen(&actions, 2, err.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    pid_t pid;
+    int spawned = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    return spawned == 0 ? pid : -1;
+}
+
+static int waitFor(pid_t pid) {
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int spawnAndWait(const std::vector<std::string>& args, const std::string& in = "", const std::string& out = "", const std::string& err = "") {
+    return waitFor(spawn(args, in, out, err));
+}
+
+// Builds bin from writeUnits' sources. Several units are compiled at once, one
+// compiler process each, and then linked.
+static bool buildApp(const std::vector<std::filesystem::path>& sources, bool parallel, const std::filesystem::path& bin) {
+    std::filesystem::path rt = runtimeDir();
+    std::vector<std::string> cxx = cxxDriver();
+    cxx.insert(cxx.end(), cxxFlags.begin(), cxxFlags.end());
+    cxx.push_back("-I" + rt.string());
+    std::vector<std::string> link = cxx;
+    if (sources.size() == 1) link.push_back(sources[0].string());
+    else {
+        std::vector<pid_t> jobs;
+        for (auto& src : sources) {
+            std::filesystem::path obj = std::filesystem::path(src).replace_extension(".o");
+            std::vector<std::string> compile = cxx;
+            compile.insert(compile.end(), { "-c", src.string(), "-o", obj.string() });
+            if (parallel) compile.push_back("-pthread");
+            jobs.push_back(spawn(compile));
+            link.push_back(obj.string());
+        }
+        bool built = true;
+        for (pid_t pid : jobs) built = waitFor(pid) == 0 && built;
+        if (!built) return false;
+    }
+    link.insert(link.end(), { "-L" + rt.string(), parallel ? "-lmhs_runtime_mt" : "-lmhs_runtime", "-o", bin.string() });
+    if (parallel) link.push_back("-pthread");
+    return spawnAndWait(link) == 0;
+}
+
+// Size, mtime and inode of a file, or "-" if it is missing: enough to notice a rebuilt
+// compiler or runtime without reading it.
+static std::string fileStamp(const std::filesystem::path& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return "-";
+    return std::to_string(st.st_size) + ' ' + std::to_string(st.st_mtim.tv_sec) + '.' + std::to_string(st.st_mtim.tv_nsec) + ' ' + std::to_string(st.st_ino);
+}
+
+// 'run': binaries are cached under a hash of the source, the stamps of the compiler
+// binary and the runtime files, and the C++ command line. Only the source is read, so
+// a hit costs one small hash before it execs the cached binary directly.
+// A miss builds in a private temp dir and renames it into place, so concurrent runs
+// never clobber each other or see a half-written binary.
+static int runCached(const std::string& path, const CompileOptions& opts, const std::vector<std::string>& progArgs) {
+    std::ifstream probe(path);
+    if (!probe) {
+        std::cout << "[MHS ERROR] Cannot read '" << path << "'" << std::endl;
+        return 1;
+    }
+    std::string source = readFile(path);
+    std::vector<std::string> cxx = cxxDriver();
+    std::filesystem::path rt = runtimeDir();
+    std::string key = source + '\0' + rt.string();
+    for (auto& f : { std::filesystem::path("/proc/self/exe"), rt / "libmhs_runtime.a", rt / "libmhs_runtime_mt.a", rt / "mhs_runtime.h", rt / "mhs_runtime_mt.h" })
+        key += '\0' + fileStamp(f);
+    for (auto& w : cxx) key += '\0' + w;
+    for (auto& fl : cxxFlags) key += '\0' + fl;
+    if (opts.lineBuffered) key += std::string(1, '\0') + "--line-buffered";
+    if (opts.profile) key += std::string(1, '\0') + "--profile";
+    if (opts.units > 1) key += std::string(1, '\0') + "--split " + std::to_string(opts.units);
+    key += std::string(1, '\0') + "-O" + std::to_string(opts.optLevel);
+    char hex[33];
+    std::snprintf(hex, sizeof(hex), "%016llx%016llx", mhsHash(key, 0), mhsHash(key, 0x9e3779b97f4a7c15ULL));
+    std::filesystem::path dir = cacheDir() / hex, bin = dir / "app";
+    if (!std::filesystem::exists(bin)) {
+        bool parallel = false;
+        std::vector<std::string> code = compileToCpp(source, opts, parallel);
+        std::filesystem::path tmp = cacheDir() / ("tmp-" + std::string(hex) + "-" + std::to_string(getpid()));
+        std::filesystem::create_directories(tmp);
+        if (!buildApp(writeUnits(tmp, code), parallel, tmp / "app")) {
+            std::cout << "[MHS ERROR] C++ build failed; generated code kept in " << tmp.string() << std::endl;
+            return 1;
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, dir, ec);
+        if (ec) std::filesystem::remove_all(tmp, ec);   // another run finished first; use its binary
+    }
+    std::vector<std::string> args = { bin.string() };
+    args.insert(args.end(), progArgs.begin(), progArgs.end());
+    std::vector<char*> argv;
+    for (auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    std::cout << "[MHS ERROR] Cannot execute " << bin.string() << std::endl;
+    return 1;
+}
+
+// --pgo: build output.cpp instrumented, run it on the training input, read the call
+// counts back with gcov, then regenerate output.cpp with hot-function hints and build
+// ./app with g++ using the collected profile. Intermediate files live in a temp dir;
+// the training run itself happens in the current directory, as the program expects.
+static int buildWithPgo(const std::string& path, CompileOptions opts, const std::string& training, const std::vector<std::string>& trainingArgs, PhaseTimer timer) {
+    std::string source = readFile(path);
+    bool parallel = false;
+    opts.units = 1;   // one object, so one output.gcda to read; hot functions may also be made inline
+    std::string code = compileToCpp(source, opts, parallel, timer)[0];
+    char tmpl[] = "/tmp/mhs-pgo-XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        std::cout << "[MHS ERROR] Cannot create a temp dir for --pgo" << std::endl;
+        return 1;
+    }
+    std::filesystem::path work = tmpl, cpp = work / "output.cpp", obj = work / "output.o", bin = work / "app";
+    std::filesystem::path rt = runtimeDir();
+    std::vector<std::string> cxx = cxxDriver();
+    cxx.insert(cxx.end(), cxxFlags.begin(), cxxFlags.end());
+    // Compiling and linking separately keeps the profile at output.gcda next to the object.
+    auto build = [&](std::vector<std::string> profileFlags) {
+        std::vector<std::string> compile = cxx, link = cxx;
+        compile.insert(compile.end(), { "-I" + rt.string(), "-c", cpp.string(), "-o", obj.string() });
+        compile.insert(compile.end(), profileFlags.begin(), profileFlags.end());
+        link.insert(link.end(), { obj.string(), "-L" + rt.string(), parallel ? "-lmhs_runtime_mt" : "-lmhs_runtime", "-o", bin.string() });
+        link.insert(link.end(), profileFlags.begin(), profileFlags.end());
+        if (parallel) link.push_back("-pthread");
+        return spawnAndWait(compile) == 0 && spawnAndWait(link) == 0;
+    };
+    auto fail = [&](const std::string& msg) {
+        std::cout << "[MHS ERROR] " << msg << "; intermediate files kept in " << work.string() << std::endl;
+        return 1;
+    };
+    std::ofstream(cpp) << code;
+    std::vector<std::string> instrument = { "-fprofile-generate", "-ftest-coverage" };
+    if (parallel) instrument.push_back("-fprofile-update=prefer-atomic");
+    if (!build(instrument)) return fail("Instrumented C++ build failed");
+    timer.lap("instrumented build");
+    std::vector<std::string> run = { bin.string() };
+    run.insert(run.end(), trainingArgs.begin(), trainingArgs.end());
+    if (spawnAndWait(run, training, "/dev/null") != 0) return fail("Training run failed");
+    timer.lap("training run");
+    // 'gcov -b' reports "function name(params) called N returned ..." per function.
+    std::filesystem::path report = work / "calls.txt";
+    if (spawnAndWait({ "gcov", "-b", "-m", "-t", (work / "output.gcda").string() }, "", report.string(), "/dev/null") != 0) return fail("gcov failed");
+    std::istringstream calls(readFile(report.string()));
+    for (std::string line; std::getline(calls, line);) {
+        size_t paren = line.find('('), called = line.find(") called ");
+        if (line.rfind("function ", 0) != 0 || paren == std::string::npos || called == std::string::npos) continue;
+        opts.callCounts[line.substr(9, paren - 9)] += std::strtoull(line.c_str() + called + 9, nullptr, 10);
+    }
+    code = compileToCpp(source, opts, parallel)[0];
+    std::ofstream(cpp) << code;
+    // Functions the training run never reached (static initializers, say) simply get no profile.
+    if (!build({ "-fprofile-use", "-fprofile-correction", "-Wno-missing-profile" })) return fail("C++ build with the profile failed");
+    timer.lap("profile build");
+    std::ofstream("output.cpp") << code;
+    std::error_code ec;
+    std::filesystem::copy_file(bin, "app", std::filesystem::copy_options::overwrite_existing, ec);
+    if (ec) return fail("Cannot write ./app");
+    std::filesystem::remove_all(work, ec);
+    size_t hot = 0;
+    for (size_t at = 0; (at = code.find("[[gnu::hot]]", at)) != std::string::npos; at++) hot++;
+    std::cerr << "[PGO] built ./app; " << hot / 2 << " hot function(s) hinted" << std::endl;   // declaration and definition
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    bool run = argc > 1 && std::string(argv[1]) == "run", interpreted = false;
+    std::string path;
+    CompileOptions opts;
+    PhaseTimer timer;
+    std::vector<std::string> progArgs;
+    std::string training;   // --pgo: file the training run reads as stdin
+    for (int i = run ? 2 : 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((run || !training.empty()) && !path.empty()) progArgs.push_back(arg);
+        else if (arg == "--pgo" && !run && i + 1 < argc) training = argv[++i];
+        else if (arg == "--line-buffered") opts.lineBuffered = true;
+        else if (arg == "--profile") opts.profile = true;
+        else if (arg == "-O0" || arg == "-O1") opts.optLevel = arg[2] - '0';
+        else if (arg == "--time-phases") timer.enabled = true;
+        else if (arg == "--split" && i + 1 < argc) opts.units = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--interpret" && !run) interpreted = true;
+        else path = arg;
+    }
+    if (path.empty()) {
+        std::cout << "Usage: mhs_compiler [-O0|-O1] [--line-buffered] [--profile] [--split N] [--time-phases] [--interpret] <file.mhs>\n"
+                     "       mhs_compiler run [-O0|-O1] [--line-buffered] [--profile] [--split N] <file.mhs> [args...]\n"
+                     "       mhs_compiler --pgo <training-stdin> [-O0|-O1] [--line-buffered] <file.mhs> [training args...]\n";
+        return 1;
+    }
+    if (run) return runCached(path, opts, progArgs);
+    if (!training.empty()) return buildWithPgo(path, opts, training, progArgs, timer);
+    bool parallel = false;
+    std::string source = readFile(path);
+    timer.lap("read");
+    if (interpreted) return interpret(source, opts, timer);
+    writeUnits(".", compileToCpp(source, opts, parallel, timer));
     return 0;
 }
@@ -0,0 +1,8 @@
+#include "mhs_runtime.h"
+
+int main() {
+    mhs_init_stdout();
+    mhs_main();
+    std::cout.flush();
+    return 0;
+}
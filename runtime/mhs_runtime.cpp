@@ -0,0 +1,573 @@
+#include "mhs_runtime.h"
+#include <sstream>
+#include <chrono>
+#include <ctime>
+#include <deque>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#ifdef MHS_PARALLEL
+#include <condition_variable>
+#include <thread>
+#endif
+
+thread_local unsigned long long mhs_heap_objects[7];
+
+void mhs_panic(const char* msg) { std::cerr << "[PANIC] " << msg << std::endl; exit(1); }
+
+StrObj::~StrObj() { if (mapped) munmap(const_cast<char*>(v.data()), mapped); }
+LinesObj::~LinesObj() { free(buf); fclose(f); }
+
+thread_local MhsAllocCache mhs_alloc_cache;
+
+// Each thread's cache is registered on its first refill so the MHS_ALLOC_STATS report
+// can sum them all; a thread that exits hands its counts over first. Under MHS_PARALLEL
+// the depot holds batches of free blocks, so memory freed on one thread and allocated
+// on another keeps circulating instead of piling up on the freeing side.
+struct MhsAllocThread;
+struct MhsAllocShared {
+    std::vector<MhsAllocThread*> threads;
+    unsigned long long allocs[MHS_SIZE_CLASSES + 1] = {}, largeBytes = 0, chunkBytes = 0;   // threads that exited
+#ifdef MHS_PARALLEL
+    std::mutex m;
+    std::vector<std::pair<MhsAllocCache::Block*, unsigned>> depot[MHS_SIZE_CLASSES];
+#endif
+};
+static MhsAllocShared& mhs_alloc_shared() { static MhsAllocShared* s = new MhsAllocShared(); return *s; }   // read at exit
+
+struct MhsAllocThread {
+    static constexpr size_t CHUNK = 64 * 1024;
+    MhsAllocCache& cache = mhs_alloc_cache;
+    char* bump = nullptr;
+    size_t left = 0;
+    unsigned long long chunkBytes = 0;
+    MhsAllocThread() {
+        MhsAllocShared& s = mhs_alloc_shared();
+#ifdef MHS_PARALLEL
+        std::lock_guard<std::mutex> g(s.m);
+#endif
+        s.threads.push_back(this);
+    }
+    ~MhsAllocThread() {
+        MhsAllocShared& s = mhs_alloc_shared();
+#ifdef MHS_PARALLEL
+        std::lock_guard<std::mutex> g(s.m);
+        for (size_t c = 0; c < MHS_SIZE_CLASSES; c++) {
+            if (cache.free[c]) s.depot[c].push_back({cache.free[c], cache.cached[c]});
+            cache.free[c] = nullptr;
+            cache.cached[c] = 0;
+        }
+#endif
+        for (size_t c = 0; c <= MHS_SIZE_CLASSES; c++) s.allocs[c] += cache.allocs[c];
+        s.largeBytes += cache.largeBytes;
+        s.chunkBytes += chunkBytes;
+        s.threads.erase(std::find(s.threads.begin(), s.threads.end(), this));
+    }
+};
+static thread_local MhsAllocThread mhs_alloc_thread;
+
+// The class's list is empty: take a batch from the depot, else carve up to 4 KB of
+// blocks from the current chunk. Returns one block and keeps the rest.
+void* MhsAllocCache::refill(size_t c) {
+    MhsAllocThread& t = mhs_alloc_thread;
+#ifdef MHS_PARALLEL
+    {
+        MhsAllocShared& s = mhs_alloc_shared();
+        std::lock_guard<std::mutex> g(s.m);
+        if (!s.depot[c].empty()) {
+            auto [head, n] = s.depot[c].back();
+            s.depot[c].pop_back();
+            free[c] = head->next;
+            cached[c] = n - 1;
+            return head;
+        }
+    }
+#endif
+    size_t size = (c + 1) * 16;
+    if (t.left < size) {
+        t.bump = static_cast<char*>(::operator new(MhsAllocThread::CHUNK));
+        t.left = MhsAllocThread::CHUNK;
+        t.chunkBytes += MhsAllocThread::CHUNK;
+    }
+    size_t n = std::min(std::max<size_t>(1, 4096 / size), t.left / size);
+    char* first = t.bump;
+    for (size_t i = 1; i < n; i++) {
+        Block* b = reinterpret_cast<Block*>(first + i * size);
+        b->next = i + 1 < n ? reinterpret_cast<Block*>(first + (i + 1) * size) : nullptr;
+    }
+    free[c] = n > 1 ? reinterpret_cast<Block*>(first + size) : nullptr;
+#ifdef MHS_PARALLEL
+    cached[c] = (unsigned)n - 1;
+#endif
+    t.bump += n * size;
+    t.left -= n * size;
+    return first;
+}
+
+void* MhsAllocCache::large(size_t n) {
+    (void)mhs_alloc_thread;   // registers the thread for the report
+    allocs[MHS_SIZE_CLASSES]++;
+    largeBytes += n;
+    return ::operator new(n);
+}
+
+void MhsAllocCache::spill(size_t c) {
+#ifdef MHS_PARALLEL
+    unsigned keep = cached[c] / 2;
+    Block* last = free[c];
+    for (unsigned i = 1; i < keep; i++) last = last->next;
+    MhsAllocShared& s = mhs_alloc_shared();
+    std::lock_guard<std::mutex> g(s.m);
+    s.depot[c].push_back({last->next, cached[c] - keep});
+    last->next = nullptr;
+    cached[c] = keep;
+#else
+    (void)c;
+#endif
+}
+
+static void mhs_alloc_report() {
+    MhsAllocShared& s = mhs_alloc_shared();
+#ifdef MHS_PARALLEL
+    std::lock_guard<std::mutex> g(s.m);
+#endif
+    unsigned long long allocs[MHS_SIZE_CLASSES + 1], largeBytes = s.largeBytes, chunkBytes = s.chunkBytes, small = 0, smallBytes = 0;
+    std::copy(s.allocs, s.allocs + MHS_SIZE_CLASSES + 1, allocs);
+    for (MhsAllocThread* t : s.threads) {
+        for (size_t c = 0; c <= MHS_SIZE_CLASSES; c++) allocs[c] += t->cache.allocs[c];
+        largeBytes += t->cache.largeBytes;
+        chunkBytes += t->chunkBytes;
+    }
+    for (size_t c = 0; c < MHS_SIZE_CLASSES; c++) { small += allocs[c]; smallBytes += allocs[c] * (c + 1) * 16; }
+    fprintf(stderr, "[ALLOC] %llu small blocks, %.1f MB from %.1f MB of chunks; %llu large blocks, %.1f MB\n",
+            small, smallBytes / 1048576.0, chunkBytes / 1048576.0, allocs[MHS_SIZE_CLASSES], largeBytes / 1048576.0);
+    fprintf(stderr, "%8s %14s %14s\n", "size", "allocations", "bytes");
+    for (size_t c = 0; c < MHS_SIZE_CLASSES; c++)
+        if (allocs[c]) fprintf(stderr, "%8zu %14llu %14llu\n", (c + 1) * 16, allocs[c], allocs[c] * (c + 1) * 16);
+    if (allocs[MHS_SIZE_CLASSES]) fprintf(stderr, "%8s %14llu %14llu\n", "large", allocs[MHS_SIZE_CLASSES], largeBytes);
+}
+static const bool mhs_alloc_stats = getenv("MHS_ALLOC_STATS") && std::atexit(mhs_alloc_report) == 0;
+
+void Value::destroy() {
+    if (type == 2) delete static_cast<StrObj*>(obj);
+    else if (type == 3) {
+        StructObj* so = static_cast<StructObj*>(obj);
+        for (int i = 0; i < so->info->nfields; i++) so->fields()[i].~Value();
+        int n = so->info->nfields;
+        so->~StructObj(); mhs_free(so, sizeof(StructObj) + n * sizeof(Value));
+    }
+    else if (type == 4) delete static_cast<ArrObj*>(obj);
+    else if (type == 5) delete static_cast<MapObj*>(obj);
+    else if (type == 6) delete static_cast<LinesObj*>(obj);
+}
+
+std::ostream& operator<<(std::ostream& os, const Value& v) {
+    if (v.type == 0) os << "null";
+    else if (v.type == 1) os << v.iVal;
+    else if (v.type == 2) os << v.str_view();
+    else if (v.type == 4) { auto& a = v.arr(); os << "["; for (size_t i = 0; i < a.size(); i++) { os << a[i]; if (i < a.size() - 1) os << ", "; } os << "]"; }
+    else if (v.type == 5) {   // keys print in sorted order, independent of insertion
+        std::vector<const MhsDict::Entry*> es;
+        for (auto& e : v.map().entries) es.push_back(&e);
+        std::sort(es.begin(), es.end(), [](auto a, auto b) { return a->key.str_view() < b->key.str_view(); });
+        os << "{";
+        for (size_t i = 0; i < es.size(); i++) { os << es[i]->key.str_view() << ": " << es[i]->val; if (i + 1 < es.size()) os << ", "; }
+        os << "}";
+    }
+    else os << "[Object]";
+    return os;
+}
+
+void Value::type_error(const char* op) { std::string m = "Type error: invalid operands for '"; m += op; m += "'"; mhs_panic(m.c_str()); }
+
+std::vector<long long> Value::as_ints() const {
+    if (type != 4) mhs_panic("Type error: expected an array");
+    std::vector<long long> out; out.reserve(arr().size());
+    for (auto& e : arr()) out.push_back(e.as_int());
+    return out;
+}
+
+Value Value::from_ints(const std::vector<long long>& ints) { std::vector<Value> elems(ints.begin(), ints.end()); return make_array(std::move(elems)); }
+
+void Value::append_slow(std::string& out) const {
+    if (type == 0) { out.append("null"); return; }
+    std::stringstream ss; ss << *this; out.append(ss.str());
+}
+
+// Symbol table for literal keys: mhs_symbols_by_id points at the symbols, and the
+// index is open-addressed over their hashes and kept at most half full.
+struct MhsSymbols {
+    std::vector<MhsSymbol> syms;
+    std::vector<unsigned> slots;   // symbol + 1, 0 when empty
+#ifdef MHS_PARALLEL
+    std::mutex m;
+#endif
+    bool find(std::string_view key, unsigned long long h, size_t& i) const {
+        if (slots.empty()) return false;
+        for (i = h & (slots.size() - 1); slots[i]; i = (i + 1) & (slots.size() - 1))
+            if (syms[slots[i] - 1].hash == h && syms[slots[i] - 1].name.str_view() == key) return true;
+        return false;
+    }
+    void grow() {
+        slots.assign(std::max<size_t>(64, slots.size() * 2), 0);
+        for (size_t n = 0; n < syms.size(); n++) {
+            size_t i = syms[n].hash & (slots.size() - 1);
+            while (slots[i]) i = (i + 1) & (slots.size() - 1);
+            slots[i] = (unsigned)n + 1;
+        }
+    }
+};
+static MhsSymbols& mhs_symbols() { static MhsSymbols* s = new MhsSymbols(); return *s; }   // outlives static destructors
+const MhsSymbol* mhs_symbols_by_id = nullptr;
+
+MhsSym mhs_intern(std::string_view key) {
+    MhsSymbols& t = mhs_symbols();
+#ifdef MHS_PARALLEL
+    std::lock_guard<std::mutex> g(t.m);
+#endif
+    unsigned long long h = mhs_hash(key, 0);
+    size_t i;
+    if (t.find(key, h, i)) return t.slots[i] - 1;
+    if ((t.syms.size() + 1) * 2 > t.slots.size()) { t.grow(); t.find(key, h, i); }
+    t.syms.push_back({h, Value(key)});
+    t.slots[i] = (unsigned)t.syms.size();
+    mhs_symbols_by_id = t.syms.data();
+    return (MhsSym)t.syms.size() - 1;
+}
+
+// write_file appends through one buffered handle per path, kept open until exit.
+struct MhsWriters {
+    std::map<std::string, FILE*, std::less<>> files;
+    FILE* get(std::string_view path) {
+        auto it = files.find(path);
+        if (it != files.end()) return it->second;
+        FILE* f = fopen(std::string(path).c_str(), "a");
+        if (f) setvbuf(f, nullptr, _IOFBF, 1 << 16);
+        return files.emplace(std::string(path), f).first->second;
+    }
+    void flush() { for (auto& [p, f] : files) if (f) fflush(f); }
+    void flush(std::string_view path) { auto it = files.find(path); if (it != files.end() && it->second) fflush(it->second); }
+    ~MhsWriters() { for (auto& [p, f] : files) if (f) fclose(f); }
+};
+static MhsWriters& mhs_writers() { static MhsWriters w; return w; }
+
+// A file this program wrote is flushed before it is read back.
+static void mhs_flush_writes(std::string_view path) {
+#ifdef MHS_PARALLEL
+    std::lock_guard<std::mutex> g(mhs_io_lock());
+#endif
+    mhs_writers().flush(path);
+}
+
+// read_file maps regular files instead of copying them; the string Value views the mapping.
+Value std_read_file(const std::string& path) {
+    mhs_flush_writes(path);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) mhs_panic(("Cannot open file: " + path).c_str());
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (size_t)st.st_size > Value::SSO_MAX) {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) mhs_panic(("Cannot map file: " + path).c_str());
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+        return Value::from_obj(2, new StrObj(static_cast<const char*>(p), st.st_size));
+    }
+    std::string s; char buf[1 << 16]; ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) s.append(buf, n);
+    close(fd);
+    return Value(s);
+}
+
+Value std_lines(const std::string& path) {
+    mhs_flush_writes(path);
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) mhs_panic(("Cannot open file: " + path).c_str());
+    setvbuf(f, nullptr, _IOFBF, 1 << 16);
+    return Value::from_obj(6, new LinesObj(f));
+}
+
+long long std_write_file(std::string_view path, std::string_view data) {
+#ifdef MHS_PARALLEL
+    std::lock_guard<std::mutex> g(mhs_io_lock());
+#endif
+    FILE* f = mhs_writers().get(path);
+    return f && fwrite(data.data(), 1, data.size(), f) == data.size();
+}
+
+long long std_write_file(std::string_view path, const Value& v) {
+    if (v.type == 2) return std_write_file(path, v.str_view());
+    std::string s = v.to_string();
+    return std_write_file(path, std::string_view(s));
+}
+
+int std_random(int min, int max) { static bool init = false; if (!init) { srand(time(0)); init = true; } return min + rand() % (max - min + 1); }
+std::string std_input() { std::cout.flush(); std::string s; std::getline(std::cin, s); return s; }
+std::string std_input(std::string prompt) { std::cout << prompt << std::flush; std::string s; std::getline(std::cin, s); return s; }
+long long std_to_int(std::string s) { try { return std::stoll(s); } catch (...) { std::cerr << "[PANIC] Invalid number: \"" << s << "\"" << std::endl; exit(1); } }
+
+std::string std_join(const Value& arr, std::string_view sep) {
+    if (arr.type != 4) mhs_panic("Type error: expected an array");
+    std::string out;
+    for (size_t i = 0; i < arr.arr().size(); i++) {
+        if (i) out.append(sep);
+        arr.arr()[i].append_to(out);
+    }
+    return out;
+}
+std::string std_join(const std::vector<long long>& arr, std::string_view sep) {
+    std::string out;
+    for (size_t i = 0; i < arr.size(); i++) {
+        if (i) out.append(sep);
+        mhs_put(out, arr[i]);
+    }
+    return out;
+}
+
+#ifdef MHS_PARALLEL
+static thread_local bool mhs_in_parallel = false;
+
+static void mhs_profile_attach();   // see the profiler below
+
+// Work-stealing pool behind 'parallel for'. The range is cut into chunks dealt
+// round-robin to per-thread deques; each thread pops its own front and steals
+// from the back of the others. Nested parallel loops run inline on their thread.
+struct MhsPool {
+    using Chunk = std::pair<long long, long long>;
+    struct Queue { std::mutex m; std::deque<Chunk> chunks; };
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::mutex m, serial;
+    std::condition_variable wake, done;
+    const std::function<void(long long, long long)>* job = nullptr;
+    unsigned long long generation = 0;
+    std::atomic<long long> pending{0};
+    MhsPool() {
+        unsigned n = std::thread::hardware_concurrency();
+        if (const char* e = getenv("MHS_THREADS")) n = (unsigned)atoi(e);
+        if (n == 0) n = 1;
+        for (unsigned i = 0; i < n; i++) queues.push_back(std::make_unique<Queue>());
+        for (unsigned i = 1; i < n; i++) std::thread([this, i] { worker(i); }).detach();
+    }
+    bool pop(size_t self, Chunk& c) {
+        for (size_t k = 0; k < queues.size(); k++) {
+            Queue& q = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> g(q.m);
+            if (q.chunks.empty()) continue;
+            if (k == 0) { c = q.chunks.front(); q.chunks.pop_front(); }
+            else { c = q.chunks.back(); q.chunks.pop_back(); }
+            return true;
+        }
+        return false;
+    }
+    void drain(size_t self) {
+        mhs_in_parallel = true;
+        Chunk c;
+        while (pop(self, c)) {
+            (*job)(c.first, c.second);
+            if (--pending == 0) { std::lock_guard<std::mutex> g(m); done.notify_all(); }
+        }
+        mhs_in_parallel = false;
+    }
+    void worker(size_t self) {
+        mhs_profile_attach();
+        unsigned long long seen = 0;
+        while (true) {
+            { std::unique_lock<std::mutex> l(m); wake.wait(l, [&] { return generation != seen; }); seen = generation; }
+            drain(self);
+        }
+    }
+    void run(long long lo, long long hi, const std::function<void(long long, long long)>& fn) {
+        if (lo > hi) return;
+        if (mhs_in_parallel || queues.size() == 1) { bool was = mhs_in_parallel; mhs_in_parallel = true; fn(lo, hi); mhs_in_parallel = was; return; }
+        std::lock_guard<std::mutex> one(serial);
+        // Bounds and chunks are inclusive and counted in steps (one less than the number of
+        // iterations), so a range ending at the largest int needs no end + 1.
+        unsigned long long steps = (unsigned long long)hi - (unsigned long long)lo;
+        unsigned long long chunk = std::max<unsigned long long>(1, steps / (queues.size() * 8));
+        {
+            std::lock_guard<std::mutex> g(m);
+            job = &fn;
+            pending = (long long)(steps / chunk + 1);
+            size_t w = 0;
+            for (unsigned long long s = (unsigned long long)lo;; w = (w + 1) % queues.size()) {
+                unsigned long long e = (unsigned long long)hi - s >= chunk ? s + chunk - 1 : (unsigned long long)hi;
+                std::lock_guard<std::mutex> q(queues[w]->m);
+                queues[w]->chunks.push_back({(long long)s, (long long)e});
+                if (e == (unsigned long long)hi) break;
+                s = e + 1;
+            }
+            generation++;
+        }
+        wake.notify_all();
+        drain(0);
+        std::unique_lock<std::mutex> l(m);
+        done.wait(l, [&] { return pending == 0; });
+    }
+};
+
+void mhs_parallel_for(long long lo, long long hi, const std::function<void(long long, long long)>& fn) {
+    static MhsPool* pool = new MhsPool();   // never destroyed: workers may outlive exit()
+    pool->run(lo, hi, fn);
+}
+std::mutex& mhs_reduce_lock() { static std::mutex m; return m; }
+std::mutex& mhs_io_lock() { static std::mutex m; return m; }
+#endif
+
+// stdout goes through one large user-space buffer, flushed at exit, before input() and on flush().
+Value mhs_flush() { std::cout.flush(); mhs_writers().flush(); return Value(); }
+
+void mhs_init_stdout() {
+    static char buf[1 << 16];
+    std::ios::sync_with_stdio(false);
+    std::cout.rdbuf()->pubsetbuf(buf, sizeof(buf));
+}
+
+// Profiler behind --profile. Each thread grows its own calling-context tree, so a
+// call costs two timestamps, a cached child lookup and a push, without locking; the
+// trees are only read at exit. Recursive calls add to a function's total time once,
+// which the report works out from the tree rather than per call.
+#if defined(__x86_64__) || defined(__i386__)
+static inline unsigned long long mhs_ticks() { return __rdtsc(); }
+#else
+static inline unsigned long long mhs_ticks() { return std::chrono::steady_clock::now().time_since_epoch().count(); }
+#endif
+
+struct MhsProfNode {
+    int fn;
+    std::vector<MhsProfNode*> children;
+    MhsProfNode* cache[8] = {};                  // children by fn % 8, most recently entered
+    unsigned long long calls = 0, ticks = 0, objects = 0;   // inclusive; the report subtracts the children
+    explicit MhsProfNode(int fn) : fn(fn) {}
+    MhsProfNode* child(int f) {
+        MhsProfNode*& slot = cache[f & 7];
+        if (slot && slot->fn == f) return slot;
+        for (MhsProfNode* c : children) if (c->fn == f) return slot = c;
+        children.push_back(new MhsProfNode(f));
+        return slot = children.back();
+    }
+};
+struct MhsProfThread {
+    struct Frame { MhsProfNode* node; unsigned long long start, objects; };
+    MhsProfNode root{-1};
+    std::vector<Frame> frames;
+    const unsigned long long* heap = nullptr;    // this thread's mhs_heap_objects; [0] is the running total
+};
+struct MhsProfiler {
+    const char* const* names = nullptr;
+    int count = 0;
+    unsigned long long startTicks = 0;
+    std::chrono::steady_clock::time_point startTime;
+    std::vector<MhsProfThread*> threads;         // the main thread first
+#ifdef MHS_PARALLEL
+    std::mutex m;
+#endif
+};
+static MhsProfiler& mhs_profiler() { static MhsProfiler* p = new MhsProfiler(); return *p; }   // never destroyed: read at exit
+static thread_local MhsProfThread* mhs_prof_self = nullptr;
+
+// Registers the calling thread: the main thread in mhs_profile_start and pool workers
+// as they start, so entering a call never has to check.
+static void mhs_profile_attach() {
+    MhsProfiler& p = mhs_profiler();
+    if (!p.names || mhs_prof_self) return;
+    MhsProfThread* t = new MhsProfThread();
+    t->heap = mhs_heap_objects;
+#ifdef MHS_PARALLEL
+    std::lock_guard<std::mutex> g(p.m);
+#endif
+    p.threads.push_back(t);
+    mhs_prof_self = t;
+}
+
+void mhs_profile_enter(int fn) {
+    MhsProfThread& t = *mhs_prof_self;
+    MhsProfNode* parent = t.frames.empty() ? &t.root : t.frames.back().node;
+    MhsProfNode* node = parent->child(fn);
+    node->calls++;
+    t.frames.push_back({node, mhs_ticks(), t.heap[0]});
+}
+
+void mhs_profile_exit() {
+    unsigned long long now = mhs_ticks();
+    MhsProfThread& t = *mhs_prof_self;
+    MhsProfThread::Frame f = t.frames.back();
+    t.frames.pop_back();
+    unsigned long long ticks = now - f.start, objects = t.heap[0] - f.objects;
+    f.node->ticks += ticks;
+    f.node->objects += objects;
+}
+
+struct MhsProfRow { unsigned long long calls = 0, total = 0, self = 0, objects = 0; };
+
+// Sums each node into its function's row and writes one folded line per calling context.
+// open counts each function's nodes on the path, so only outermost calls add to total.
+static void mhs_profile_walk(const MhsProfNode& n, std::string& stack, std::vector<int>& open, std::vector<MhsProfRow>& rows, FILE* folded, double usPerTick) {
+    MhsProfiler& p = mhs_profiler();
+    for (const MhsProfNode* c : n.children) {
+        size_t mark = stack.size();
+        if (mark) stack += ';';
+        stack += p.names[c->fn];
+        unsigned long long selfTicks = c->ticks, selfObjects = c->objects;
+        for (const MhsProfNode* g : c->children) { selfTicks -= g->ticks; selfObjects -= g->objects; }
+        MhsProfRow& r = rows[c->fn];
+        r.calls += c->calls;
+        if (open[c->fn] == 0) r.total += c->ticks;
+        r.self += selfTicks;
+        r.objects += selfObjects;
+        unsigned long long us = (unsigned long long)(selfTicks * usPerTick + 0.5);
+        if (folded && us) fprintf(folded, "%s %llu\n", stack.c_str(), us);
+        open[c->fn]++;
+        mhs_profile_walk(*c, stack, open, rows, folded, usPerTick);
+        open[c->fn]--;
+        stack.resize(mark);
+    }
+}
+
+static void mhs_profile_report() {
+    MhsProfiler& p = mhs_profiler();
+    if (mhs_prof_self) while (!mhs_prof_self->frames.empty()) mhs_profile_exit();   // exit() from inside a call
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - p.startTime).count();
+    unsigned long long ticks = mhs_ticks() - p.startTicks;
+    double msPerTick = ticks ? ms / (double)ticks : 0;
+    const char* path = getenv("MHS_PROFILE_OUT");
+    if (!path) path = "mhs_profile.folded";
+    FILE* folded = fopen(path, "w");
+    std::vector<MhsProfRow> rows(p.count);
+    std::vector<int> open(p.count, 0);
+    unsigned long long heap[7] = {};
+#ifdef MHS_PARALLEL
+    std::lock_guard<std::mutex> g(p.m);
+#endif
+    for (size_t i = 0; i < p.threads.size(); i++) {
+        MhsProfThread* t = p.threads[i];
+        for (int k = 0; k < 7; k++) heap[k] += t->heap[k];
+        std::string stack = i ? "[worker]" : "";
+        mhs_profile_walk(t->root, stack, open, rows, folded, msPerTick * 1000);
+    }
+    if (folded) fclose(folded);
+    std::vector<int> order;
+    for (int f = 0; f < p.count; f++) if (rows[f].calls) order.push_back(f);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return rows[a].self > rows[b].self; });
+    fprintf(stderr, "[PROFILE] %.1f ms; heap objects: %llu strings, %llu structs, %llu arrays, %llu maps, %llu line streams\n",
+            ms, heap[2], heap[3], heap[4], heap[5], heap[6]);
+    fprintf(stderr, "%12s %12s %12s %7s %12s  %s\n", "calls", "total ms", "self ms", "self %", "objects", "function");
+    for (int f : order) {
+        const MhsProfRow& r = rows[f];
+        fprintf(stderr, "%12llu %12.2f %12.2f %6.1f%% %12llu  %s\n", r.calls, r.total * msPerTick, r.self * msPerTick,
+                ms > 0 ? 100 * r.self * msPerTick / ms : 0.0, r.objects, p.names[f]);
+    }
+    if (folded) fprintf(stderr, "[PROFILE] folded stacks (microseconds of self time) in %s\n", path);
+}
+
+void mhs_profile_start(const char* const* names, int count) {
+    MhsProfiler& p = mhs_profiler();
+    p.names = names;
+    p.count = count;
+    p.startTime = std::chrono::steady_clock::now();
+    p.startTicks = mhs_ticks();
+    mhs_profile_attach();
+    std::atexit(mhs_profile_report);
+}
@@ -0,0 +1,437 @@
+// MHS runtime: the Value representation and the builtins generated code calls.
+// Built once into libmhs_runtime.a (libmhs_runtime_mt.a with MHS_PARALLEL) and
+// precompiled, so each generated program only includes and links it.
+#ifndef MHS_RUNTIME_H
+#define MHS_RUNTIME_H
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <limits>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <new>
+#ifdef MHS_PARALLEL
+#include <atomic>
+#include <functional>
+#include <mutex>
+#endif
+
+struct Value;
+using MhsMethodFn = Value (*)(const Value& self, const Value* args);
+[[noreturn]] void mhs_panic(const char* msg);
+
+// Unboxed helpers used by type-specialized code.
+inline long long mhs_add(long long a, long long b) { long long r; if (__builtin_add_overflow(a, b, &r)) mhs_panic("Overflow"); return r; }
+inline long long mhs_sub(long long a, long long b) { long long r; if (__builtin_sub_overflow(a, b, &r)) mhs_panic("Overflow"); return r; }
+inline long long mhs_mul(long long a, long long b) { long long r; if (__builtin_mul_overflow(a, b, &r)) mhs_panic("Overflow"); return r; }
+inline long long mhs_div(long long a, long long b) {
+    if (b == 0) mhs_panic("Division by zero");
+    if (a == std::numeric_limits<long long>::min() && b == -1) mhs_panic("Overflow");
+    return a / b;
+}
+inline long long mhs_at(const std::vector<long long>& a, long long i) { if (i < 0 || i >= (long long)a.size()) mhs_panic("Index out of bounds"); return a[i]; }
+inline void mhs_set(std::vector<long long>& a, long long i, long long v) { if (i < 0 || i >= (long long)a.size()) mhs_panic("Index out of bounds"); a[i] = v; }
+// Seeded FNV-1a; must stay identical to mhsHash in the compiler.
+inline unsigned long long mhs_hash(std::string_view s, unsigned long long seed) {
+    unsigned long long h = 1469598103934665603ULL ^ seed;
+    for (unsigned char c : s) { h ^= c; h *= 1099511628211ULL; }
+    return h ^ (h >> 32);
+}
+inline std::string mhs_str_at(std::string_view s, long long i) { if (i < 0 || i >= (long long)s.size()) mhs_panic("Index out of bounds"); return std::string(1, s[i]); }
+
+// Small runtime blocks (object headers, struct slots, map tables) come from per-thread
+// free lists in 16-byte size classes up to MHS_SMALL_MAX, carved from 64 KB chunks that
+// are never returned to the system; bigger ones go to operator new. A block may be freed
+// on any thread and joins that thread's list. With MHS_ALLOC_STATS set, counts and
+// bytes per class are printed to stderr at exit.
+constexpr size_t MHS_SMALL_MAX = 256, MHS_SIZE_CLASSES = MHS_SMALL_MAX / 16;
+struct MhsAllocCache {
+    struct Block { Block* next; };
+    Block* free[MHS_SIZE_CLASSES];
+    unsigned long long allocs[MHS_SIZE_CLASSES + 1];   // the last slot counts large blocks
+    unsigned long long largeBytes;
+#ifdef MHS_PARALLEL
+    unsigned cached[MHS_SIZE_CLASSES];                 // past a limit, half goes back to a shared depot
+#endif
+    void* refill(size_t c);
+    void* large(size_t n);
+    void spill(size_t c);
+};
+extern thread_local MhsAllocCache mhs_alloc_cache;
+inline void* mhs_alloc(size_t n) {
+    MhsAllocCache& a = mhs_alloc_cache;
+    if (n > MHS_SMALL_MAX) return a.large(n);
+    size_t c = (n - 1) >> 4;
+    a.allocs[c]++;
+    MhsAllocCache::Block* b = a.free[c];
+    if (!b) return a.refill(c);
+    a.free[c] = b->next;
+#ifdef MHS_PARALLEL
+    a.cached[c]--;
+#endif
+    return b;
+}
+inline void mhs_free(void* p, size_t n) {
+    if (n > MHS_SMALL_MAX) { ::operator delete(p); return; }
+    MhsAllocCache& a = mhs_alloc_cache;
+    size_t c = (n - 1) >> 4;
+    MhsAllocCache::Block* b = static_cast<MhsAllocCache::Block*>(p);
+    b->next = a.free[c];
+    a.free[c] = b;
+#ifdef MHS_PARALLEL
+    if (++a.cached[c] > 4096) a.spill(c);
+#endif
+}
+template <typename T> struct MhsAllocator {
+    using value_type = T;
+    MhsAllocator() = default;
+    template <typename U> MhsAllocator(const MhsAllocator<U>&) {}
+    T* allocate(size_t n) { return static_cast<T*>(mhs_alloc(n * sizeof(T))); }
+    void deallocate(T* p, size_t n) { mhs_free(p, n * sizeof(T)); }
+    friend bool operator==(MhsAllocator, MhsAllocator) { return true; }
+    friend bool operator!=(MhsAllocator, MhsAllocator) { return false; }
+};
+
+// Heap payloads are intrusively refcounted; the owning Value's type says which kind it is.
+// Values are shared between pool threads under MHS_PARALLEL, so refcounts are atomic there.
+#ifdef MHS_PARALLEL
+using MhsRefCount = std::atomic<long>;
+#else
+using MhsRefCount = long;
+#endif
+struct Obj {
+    MhsRefCount rc{1};
+    static void* operator new(size_t n) { return mhs_alloc(n); }
+    static void operator delete(void* p, size_t n) { mhs_free(p, n); }
+};
+// A string owns its bytes in s, or views an mmap'd file that it unmaps when freed.
+struct StrObj : Obj {
+    std::string s; std::string_view v; size_t mapped = 0;
+    explicit StrObj(std::string_view x) : s(x), v(s) {}
+    explicit StrObj(std::string&& x) : s(std::move(x)), v(s) {}
+    StrObj(const char* p, size_t n) : v(p, n), mapped(n) {}
+    ~StrObj();
+};
+// Line stream for lines(path): one reusable getline buffer, so memory stays constant.
+struct LinesObj : Obj {
+    FILE* f; char* buf = nullptr; size_t cap = 0; ssize_t n = -1;
+    explicit LinesObj(FILE* f) : f(f) {}
+    ~LinesObj();
+    bool next() { n = getline(&buf, &cap, f); return n >= 0; }
+    std::string_view line() const {
+        size_t k = n > 0 ? (size_t)n : 0;
+        if (k && buf[k - 1] == '\n') k--;
+        if (k && buf[k - 1] == '\r') k--;
+        return std::string_view(buf, k);
+    }
+};
+struct ArrObj : Obj { std::vector<Value> v; };
+// Map entries carry their key string and its hash, so a key built at run time is
+// hashed once and stored in the map that holds it. Literal keys are interned at
+// startup into symbols that cache the same hash and string; the table is filled
+// before the program runs and read without a lock after that.
+using MhsSym = unsigned;
+MhsSym mhs_intern(std::string_view key);
+struct MhsDict;
+// Struct layouts are fixed at compile time: the field slots follow the header directly.
+struct StructInfo {
+    const char* name; int typeId; int nfields; const char* const* fields;
+    const MhsMethodFn* vtable;   // indexed by the compile-time (name, arity) method slot
+    int find(std::string_view f) const { for (int i = 0; i < nfields; i++) if (f == fields[i]) return i; return -1; }
+};
+struct StructObj : Obj { const StructInfo* info = nullptr; Value* fields() { return reinterpret_cast<Value*>(this + 1); } };
+// Heap objects created on this thread, by type tag; --profile charges them to functions.
+// Slot 0 (null is never on the heap) keeps the running total across all tags.
+extern thread_local unsigned long long mhs_heap_objects[7];
+inline void mhs_count_heap(int t) { mhs_heap_objects[t]++; mhs_heap_objects[0]++; }
+
+// 16-byte tagged value: type 0 null, 1 int, 2 string, 3 struct, 4 array, 5 map, 6 line stream.
+// Strings up to SSO_MAX bytes live inline from byte 2; slen == HEAP marks an owned Obj*.
+struct Value {
+    static constexpr unsigned char HEAP = 0xFF;
+    static constexpr size_t SSO_MAX = 14;
+    unsigned char type; unsigned char slen; char sso[6];
+    union { long long iVal; Obj* obj; unsigned long long bits; };
+    Value() : type(0), slen(0), sso{}, bits(0) {}
+    Value(int i) : type(1), slen(0), sso{}, iVal(i) {}
+    Value(long long i) : type(1), slen(0), sso{}, iVal(i) {}
+    Value(std::string_view s) : type(2), slen(0), sso{}, bits(0) {
+        if (s.size() <= SSO_MAX) { slen = (unsigned char)s.size(); std::memcpy(sbuf(), s.data(), s.size()); }
+        else { slen = HEAP; obj = new StrObj(s); mhs_count_heap(2); }
+    }
+    Value(const std::string& s) : Value(std::string_view(s)) {}
+    Value(const char* s) : Value(std::string_view(s)) {}
+    Value(const Value& o) : type(o.type), slen(o.slen), bits(o.bits) { std::memcpy(sso, o.sso, sizeof(sso)); if (slen == HEAP) obj->rc++; }
+    Value(Value&& o) noexcept : type(o.type), slen(o.slen), bits(o.bits) { std::memcpy(sso, o.sso, sizeof(sso)); o.type = 0; o.slen = 0; o.bits = 0; }
+    Value& operator=(const Value& o) { Value t(o); swap(t); return *this; }
+    Value& operator=(Value&& o) noexcept { Value t(std::move(o)); swap(t); return *this; }
+    ~Value() { if (slen == HEAP && --obj->rc == 0) destroy(); }
+    void swap(Value& o) noexcept { char t[sizeof(Value)]; std::memcpy(t, (void*)this, sizeof(Value)); std::memcpy((void*)this, (void*)&o, sizeof(Value)); std::memcpy((void*)&o, t, sizeof(Value)); }
+    void destroy();
+    char* sbuf() { return reinterpret_cast<char*>(this) + 2; }
+    const char* sbuf() const { return reinterpret_cast<const char*>(this) + 2; }
+    std::string_view str_view() const { if (type != 2) return {}; if (slen == HEAP) return static_cast<StrObj*>(obj)->v; return std::string_view(sbuf(), slen); }
+    std::string str() const { return std::string(str_view()); }
+    std::vector<Value>& arr() const { return static_cast<ArrObj*>(obj)->v; }
+    MhsDict& map() const;
+    static Value from_obj(int t, Obj* o) { mhs_count_heap(t); Value v; v.type = (unsigned char)t; v.slen = HEAP; v.obj = o; return v; }
+    static Value from_string(std::string&& s) { return s.size() <= SSO_MAX ? Value(std::string_view(s)) : from_obj(2, new StrObj(std::move(s))); }
+    static Value make_array(std::vector<Value> elems) { ArrObj* a = new ArrObj(); a->v = std::move(elems); return from_obj(4, a); }
+    static Value make_map(MhsDict elems);
+    int len() const;
+    void array_push(Value v) const { if (type == 4) arr().push_back(std::move(v)); }
+    Value at(const Value& idx) const {
+        if (type == 4) { long long i = idx.iVal; if (idx.type != 1 || i < 0 || i >= (long long)arr().size()) mhs_panic("Index out of bounds"); return arr()[i]; }
+        if (type == 5) return at_key(idx.str_view());
+        return Value();
+    }
+    Value at_key(std::string_view key) const;
+    Value at_sym(MhsSym k) const;   // index by a literal key interned at startup
+    void set(const Value& idx, Value val) const {
+        if (type == 4) { long long i = idx.iVal; if (idx.type != 1 || i < 0 || i >= (long long)arr().size()) mhs_panic("Index out of bounds"); arr()[i] = std::move(val); }
+        if (type == 5) set_key(idx.type == 2 ? idx : Value(""), std::move(val));
+    }
+    void set_key(const Value& key, Value val) const;
+    void set_sym(MhsSym k, Value val) const;
+    static Value new_struct(const StructInfo* info) {
+        StructObj* so = ::new (mhs_alloc(sizeof(StructObj) + info->nfields * sizeof(Value))) StructObj();
+        so->info = info;
+        for (int i = 0; i < info->nfields; i++) new (so->fields() + i) Value();
+        return from_obj(3, so);
+    }
+    Value get_safe(std::string_view name) const {
+        if (type == 3) { StructObj* so = static_cast<StructObj*>(obj); int i = so->info->find(name); return i < 0 ? Value() : so->fields()[i]; }
+        return type == 5 ? at_key(name) : Value();
+    }
+    Value get_safe(std::string_view name, MhsSym k) const { return type == 5 ? at_sym(k) : get_safe(name); }
+    Value next_line() const {
+        if (type != 6) mhs_panic("Type error: expected lines(...)");
+        LinesObj* l = static_cast<LinesObj*>(obj);
+        return l->next() ? Value(l->line()) : Value();
+    }
+    bool is_true() const { return (type == 1 && iVal != 0) || (type == 2 && slen != 0); }
+    friend std::ostream& operator<<(std::ostream& os, const Value& v);
+    // Arithmetic dispatches on the tags: 64-bit ints take the checked fast path,
+    // '+' concatenates only when one side is a string, anything else is a type error.
+    Value operator+(const Value& o) const {
+        if (type == 1 && o.type == 1) return Value(mhs_add(iVal, o.iVal));
+        if (type == 2 || o.type == 2) { std::string s; append_to(s); o.append_to(s); return from_string(std::move(s)); }
+        type_error("+");
+    }
+    Value operator-(const Value& o) const { return Value(mhs_sub(int_operand("-"), o.int_operand("-"))); }
+    Value operator*(const Value& o) const { return Value(mhs_mul(int_operand("*"), o.int_operand("*"))); }
+    Value operator/(const Value& o) const { return Value(mhs_div(int_operand("/"), o.int_operand("/"))); }
+    int compare(const Value& o, const char* op) const {
+        if (type == 1 && o.type == 1) return (iVal > o.iVal) - (iVal < o.iVal);
+        if (type == 2 && o.type == 2) { int c = str_view().compare(o.str_view()); return (c > 0) - (c < 0); }
+        type_error(op);
+    }
+    Value operator>(const Value& o) const { return Value((long long)(compare(o, ">") > 0)); }
+    Value operator<(const Value& o) const { return Value((long long)(compare(o, "<") < 0)); }
+    Value operator==(const Value& o) const {
+        if (type != o.type) return Value(0);
+        if (type == 1) return Value((int)(iVal == o.iVal));
+        if (type == 2) return Value((int)(str_view() == o.str_view()));
+        if (type == 0) return Value(1);
+        return Value((int)(obj == o.obj));
+    }
+    Value operator!=(const Value& o) const { return Value((int)!((*this == o).is_true())); }
+    [[noreturn]] static void type_error(const char* op);
+    long long int_operand(const char* op) const { if (type != 1) type_error(op); return iVal; }
+    long long as_int() const { if (type != 1) mhs_panic("Type error: expected an int"); return iVal; }
+    std::string as_str() const { if (type != 2) mhs_panic("Type error: expected a string"); return str(); }
+    std::vector<long long> as_ints() const;
+    static Value from_ints(const std::vector<long long>& ints);
+    void append_to(std::string& out) const {
+        if (type == 1) { char buf[24]; int n = std::snprintf(buf, sizeof(buf), "%lld", iVal); out.append(buf, n); }
+        else if (type == 2) out.append(str_view());
+        else append_slow(out);
+    }
+    void append_slow(std::string& out) const;
+    std::string to_string() const { std::string s; append_to(s); return s; }
+};
+static_assert(sizeof(Value) == 16, "Value must stay a 16-byte tagged word pair");
+
+struct MhsSymbol { unsigned long long hash; Value name; };
+extern const MhsSymbol* mhs_symbols_by_id;   // indexed by MhsSym
+
+// Insertion-ordered entries behind an open-addressing index of entry numbers
+// (0 marks an empty slot), kept at most half full and probed linearly.
+struct MhsDict {
+    struct Entry { unsigned long long hash; Value key; Value val; };
+    std::vector<Entry, MhsAllocator<Entry>> entries;
+    std::vector<unsigned, MhsAllocator<unsigned>> slots;
+    size_t size() const { return entries.size(); }
+    size_t home(unsigned long long h) const { return (size_t)((h * 0x9E3779B97F4A7C15ULL) >> 32) & (slots.size() - 1); }
+    Value* find(unsigned long long h, std::string_view key) {
+        if (slots.empty()) return nullptr;
+        for (size_t i = home(h);; i = (i + 1) & (slots.size() - 1)) {
+            unsigned e = slots[i];
+            if (e == 0) return nullptr;
+            const Entry& en = entries[e - 1];
+            if (en.hash == h && en.key.str_view() == key) return &entries[e - 1].val;
+        }
+    }
+    Value* find(MhsSym k) { const MhsSymbol& s = mhs_symbols_by_id[k]; return find(s.hash, s.name.str_view()); }
+    // Returns the value stored under key (a string), inserting a null one if key is new.
+    Value& get(unsigned long long h, const Value& key) {
+        if ((entries.size() + 1) * 2 > slots.size()) grow();
+        std::string_view kv = key.str_view();
+        size_t i = home(h);
+        for (unsigned e; (e = slots[i]) != 0; i = (i + 1) & (slots.size() - 1))
+            if (entries[e - 1].hash == h && entries[e - 1].key.str_view() == kv) return entries[e - 1].val;
+        entries.push_back({h, key, Value()});
+        slots[i] = (unsigned)entries.size();
+        return entries.back().val;
+    }
+    Value& get(MhsSym k) { const MhsSymbol& s = mhs_symbols_by_id[k]; return get(s.hash, s.name); }
+    void grow() {
+        slots.assign(std::max<size_t>(8, slots.size() * 2), 0);
+        for (size_t n = 0; n < entries.size(); n++) {
+            size_t i = home(entries[n].hash);
+            while (slots[i]) i = (i + 1) & (slots.size() - 1);
+            slots[i] = (unsigned)n + 1;
+        }
+    }
+};
+struct MapObj : Obj { MhsDict m; };
+inline MhsDict& Value::map() const { return static_cast<MapObj*>(obj)->m; }
+inline Value Value::make_map(MhsDict elems) { MapObj* m = new MapObj(); m->m = std::move(elems); return from_obj(5, m); }
+inline int Value::len() const { if (type == 4) return arr().size(); if (type == 5) return map().size(); return 0; }
+inline Value Value::at_key(std::string_view key) const {
+    Value* v = map().find(mhs_hash(key, 0), key);
+    return v ? *v : Value();
+}
+inline void Value::set_key(const Value& key, Value val) const { map().get(mhs_hash(key.str_view(), 0), key) = std::move(val); }
+inline Value Value::at_sym(MhsSym k) const {
+    if (type == 4) mhs_panic("Index out of bounds");
+    if (type != 5) return Value();
+    Value* v = map().find(k);
+    return v ? *v : Value();
+}
+inline void Value::set_sym(MhsSym k, Value val) const {
+    if (type == 4) mhs_panic("Index out of bounds");
+    if (type == 5) map().get(k) = std::move(val);
+}
+
+// parallel for: a shared container may only be written at the loop's own index,
+// which is a distinct slot per iteration only if the container is an array.
+inline void mhs_set_slot(const Value& a, const Value& i, Value v) {
+    if (a.type != 4) mhs_panic("Type error: 'parallel for' can only write to shared arrays");
+    a.set(i, std::move(v));
+}
+// parallel for: iterating a shared value is a read unless it is a lines(...) stream,
+// whose single cursor every iteration would advance.
+inline const Value& mhs_shared_iterable(const Value& v) {
+    if (v.type == 6) mhs_panic("Type error: 'parallel for' cannot iterate over a shared lines() stream");
+    return v;
+}
+inline Value& mhs_field(const Value& v, int i) { return static_cast<StructObj*>(v.obj)->fields()[i]; }
+// 's := s + piece' appends in place, so building a string from n pieces is linear.
+// A string Value grows its buffer when it holds the only reference to it; a shared,
+// inline or mapped string is copied once into an owned buffer first.
+inline void mhs_put(std::string& s, std::string_view p) { s.append(p); }
+inline void mhs_put(std::string& s, const std::string& p) { s.append(p); }
+inline void mhs_put(std::string& s, long long i) { char buf[24]; s.append(buf, std::snprintf(buf, sizeof(buf), "%lld", i)); }
+inline void mhs_put(std::string& s, const Value& p) { p.append_to(s); }
+template <typename P> void mhs_append(std::string& s, const P& p) { mhs_put(s, p); }
+template <typename P> void mhs_append(Value& s, const P& p) {
+    if (s.type != 2) { s = s + Value(p); return; }   // not a string yet: '+' decides what this means
+    if (s.slen == Value::HEAP && s.obj->rc == 1) {
+        StrObj* o = static_cast<StrObj*>(s.obj);
+        if (!o->mapped) { mhs_put(o->s, p); o->v = o->s; return; }
+    }
+    std::string b(s.str_view());
+    mhs_put(b, p);
+    s = Value::from_string(std::move(b));
+}
+// Array and map literals: elements are moved in, never copied out of an initializer_list.
+template <typename... A> Value mhs_array(A&&... elems) {
+    std::vector<Value> v;
+    v.reserve(sizeof...(A));
+    (v.emplace_back(std::forward<A>(elems)), ...);
+    return Value::make_array(std::move(v));
+}
+inline void mhs_map_put(MhsDict&) {}
+template <typename V, typename... A> void mhs_map_put(MhsDict& m, MhsSym key, V&& val, A&&... rest) {
+    size_t n = m.size();
+    Value& slot = m.get(key);
+    if (m.size() > n) slot = Value(std::forward<V>(val));   // the first of duplicate keys wins
+    mhs_map_put(m, std::forward<A>(rest)...);
+}
+template <typename... A> Value mhs_map(A&&... kv) {   // key symbol, value, key symbol, value, ...
+    MhsDict m;
+    mhs_map_put(m, std::forward<A>(kv)...);
+    return Value::make_map(std::move(m));
+}
+// Dynamic method call: arguments travel in a stack array, never a heap vector.
+template <typename... A> Value mhs_invoke(const Value& obj, int method, A&&... args) {
+    const Value argv[sizeof...(A) + 1] = {Value(std::forward<A>(args))...};
+    MhsMethodFn f = nullptr;
+    if (obj.type == 3 && method >= 0) { const StructInfo* info = static_cast<StructObj*>(obj.obj)->info; if (info->vtable) f = info->vtable[method]; }
+    if (!f) mhs_panic("Method not found");
+    return f(obj, argv);
+}
+// 'for x in ...': arrays are walked by index, line streams one line at a time.
+struct MhsCursor {
+    Value src, cur; size_t i = 0;
+    explicit MhsCursor(Value v) : src(std::move(v)) { if (src.type != 4 && src.type != 6) mhs_panic("Type error: value is not iterable"); }
+    bool next() {
+        if (src.type == 6) return static_cast<LinesObj*>(src.obj)->next();
+        if (i >= src.arr().size()) return false;
+        cur = src.arr()[i++];
+        return true;
+    }
+    Value value() const { return src.type == 6 ? Value(static_cast<LinesObj*>(src.obj)->line()) : cur; }
+    std::string_view text() const { return src.type == 6 ? static_cast<LinesObj*>(src.obj)->line() : cur.str_view(); }
+};
+
+// Builtins.
+Value std_read_file(const std::string& path);
+Value std_lines(const std::string& path);
+long long std_write_file(std::string_view path, std::string_view data);
+long long std_write_file(std::string_view path, const Value& v);
+int std_random(int min, int max);
+std::string std_input();
+std::string std_input(std::string prompt);
+long long std_to_int(std::string s);
+std::string std_join(const Value& arr, std::string_view sep);
+std::string std_join(const std::vector<long long>& arr, std::string_view sep);
+Value mhs_flush();
+void mhs_init_stdout();   // before any output: buffer stdout, detached from C stdio
+
+// --profile: every generated function opens an MhsProfileScope. Calls are timed on a
+// calling-context tree per thread; at exit a report sorted by self time goes to
+// stderr and the stacks to a folded file for flame-graph tools.
+void mhs_profile_start(const char* const* names, int count);
+void mhs_profile_enter(int fn);
+void mhs_profile_exit();
+struct MhsProfileScope {
+    explicit MhsProfileScope(int fn) { mhs_profile_enter(fn); }
+    ~MhsProfileScope() { mhs_profile_exit(); }
+    MhsProfileScope(const MhsProfileScope&) = delete;
+    MhsProfileScope& operator=(const MhsProfileScope&) = delete;
+};
+
+#ifdef MHS_PARALLEL
+// Runs fn over inclusive chunks of [lo, hi] on the work-stealing pool and returns when all are done.
+void mhs_parallel_for(long long lo, long long hi, const std::function<void(long long, long long)>& fn);
+std::mutex& mhs_reduce_lock();
+std::mutex& mhs_io_lock();
+template <typename T> void mhs_print(const T& v, bool flush) {
+    std::lock_guard<std::mutex> g(mhs_io_lock());
+    std::cout << v << '\n';
+    if (flush) std::cout.flush();
+}
+#endif
+
+// Entry point of the generated program; main() lives in the runtime library
+// (mhs_main.cpp), in an archive member of its own so other hosts can link the rest.
+Value mhs_main();
+
+#endif
@@ -0,0 +1,8 @@
+// Thread-safe runtime for programs that use 'parallel for'. A separate header
+// so that it gets its own precompiled header and links libmhs_runtime_mt.a.
+#ifndef MHS_RUNTIME_MT_H
+#define MHS_RUNTIME_MT_H
+#define MHS_PARALLEL
+#include "mhs_runtime.h"
+
+#endif
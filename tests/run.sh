@@ -0,0 +1,66 @@
+#!/bin/sh
+# Golden-output tests, run by 'make test'.
+#   tests/NAME.mhs         built and run at -O0, -O1 and -O1 --split 3 (three translation
+#                          units sharing output.h), and run with --interpret; its
+#                          stdout followed by its stderr must equal NAME.expected, or
+#                          NAME.O0.expected at -O0 when the optimizer changes the outcome
+#   tests/errors/NAME.mhs  must be rejected at compile time, at -O0 and -O1 and with
+#                          --interpret, with the output in NAME.expected
+#   tests/methods.mhs and tests/parallel.mhs also run with --profile; see below
+# Each run starts in an empty scratch directory. Usage: tests/run.sh [path/to/mhs_compiler]
+mhsc=$(realpath "${1:-./mhs_compiler}")
+tests=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+passed=0
+failed=0
+
+# check NAME MODE EXPECTED WANT_FAILURE COMMAND... (sh functions share variables,
+# so the arguments keep names of their own)
+check() {
+    checkName=$1 checkMode=$2 checkExpected=$3 wantFailure=$4
+    shift 4
+    rm -rf "$work/run" && mkdir "$work/run"
+    (cd "$work/run" && "$@" >"$work/stdout" 2>"$work/stderr")
+    status=$?
+    cat "$work/stdout" "$work/stderr" >"$work/actual"
+    if [ "$wantFailure" = 1 ] && [ $status = 0 ]; then
+        echo "FAIL $checkName ($checkMode): compiled, but should have been rejected"
+        failed=$((failed + 1))
+    elif ! diff -u "$checkExpected" "$work/actual" >"$work/diff"; then
+        echo "FAIL $checkName ($checkMode)"
+        sed 's/^/    /' "$work/diff"
+        failed=$((failed + 1))
+    else
+        passed=$((passed + 1))
+    fi
+}
+
+for src in "$tests"/*.mhs; do
+    name=$(basename "$src" .mhs)
+    expected="$tests/$name.expected"
+    o0="$expected"
+    [ -f "$tests/$name.O0.expected" ] && o0="$tests/$name.O0.expected"
+    check "$name" -O0 "$o0" 0 "$mhsc" run -O0 "$src"
+    check "$name" -O1 "$expected" 0 "$mhsc" run -O1 "$src"
+    check "$name" "-O1 --split 3" "$expected" 0 "$mhsc" run -O1 --split 3 "$src"
+    check "$name" --interpret "$expected" 0 "$mhsc" --interpret "$src"
+done
+# --profile must leave stdout alone and write mhs_profile.folded. Its report on
+# stderr is all timings, so it is dropped.
+unset MHS_PROFILE_OUT
+for name in methods parallel; do
+    check "$name" --profile "$tests/$name.expected" 0 sh -c \
+        '"$0" run --profile "$1" 2>/dev/null; [ -f mhs_profile.folded ] || echo "mhs_profile.folded not written"' \
+        "$mhsc" "$tests/$name.mhs"
+done
+for src in "$tests"/errors/*.mhs; do
+    [ -f "$src" ] || continue
+    name=errors/$(basename "$src" .mhs)
+    for mode in -O0 -O1 --interpret; do
+        check "$name" $mode "$tests/$name.expected" 1 "$mhsc" $mode "$src"
+    done
+done
+
+echo "$passed passed, $failed failed"
+[ $failed = 0 ]